@@ -52,6 +52,25 @@ binit(void)
   }
 }
 
+// Write locked buffer b home if it is dirty (or, if write
+// is 0, let the log mark it clean), and release it without
+// making it the most recently used.
+static void
+bclean(struct buf *b, int write)
+{
+  if(b->dirty){
+    if(write){
+      virtio_disk_rw(b, 1);
+      b->dirty = 0;
+    } else
+      log_forget(b);
+  }
+  releasesleep(&b->lock);
+  acquire(&bcache.lock);
+  b->refcnt--;
+  release(&bcache.lock);
+}
+
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
@@ -60,6 +79,7 @@ bget(uint dev, uint blockno)
 {
   struct buf *b;
 
+again:
   acquire(&bcache.lock);
 
   // Is the block already cached?
@@ -73,9 +93,9 @@ bget(uint dev, uint blockno)
   }
 
   // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
+  // Recycle the least recently used (LRU) unused clean buffer.
   for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
+    if(b->refcnt == 0 && !b->dirty) {
       b->dev = dev;
       b->blockno = blockno;
       b->valid = 0;
@@ -85,6 +105,18 @@ bget(uint dev, uint blockno)
       return b;
     }
   }
+
+  // Every unused buffer holds a committed block that is not
+  // home yet.  Write the LRU one home, and look again.
+  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
+    if(b->refcnt == 0) {
+      b->refcnt = 1;
+      release(&bcache.lock);
+      acquiresleep(&b->lock);
+      bclean(b, 1);
+      goto again;
+    }
+  }
   panic("bget: no buffers");
 }
 
@@ -111,6 +143,19 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
+// Write the n locked buffers in bufs to disk at once,
+// bufs[i] to block to[i], which need not be its own block.
+void
+bwritev(struct buf **bufs, uint *to, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(!holdingsleep(&bufs[i]->lock))
+      panic("bwritev");
+  virtio_disk_writev(bufs, to, n);
+}
+
 // Release a locked buffer.
 // Move to the head of the most-recently-used list.
 void
@@ -136,6 +181,43 @@ brelse(struct buf *b)
   release(&bcache.lock);
 }
 
+// If block blockno is cached and dirty, write it home
+// (or, if write is 0, just mark it clean).
+static void
+bsync(uint dev, uint blockno, int write)
+{
+  struct buf *b;
+
+  acquire(&bcache.lock);
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      if(!b->dirty)
+        break;
+      b->refcnt++;
+      release(&bcache.lock);
+      acquiresleep(&b->lock);
+      bclean(b, write);
+      return;
+    }
+  }
+  release(&bcache.lock);
+}
+
+// For checkpoints of the log.
+void
+bflush(uint dev, uint blockno)
+{
+  bsync(dev, blockno, 1);
+}
+
+// For blocks that have been freed: their contents
+// need never reach the disk.
+void
+bforget(uint dev, uint blockno)
+{
+  bsync(dev, blockno, 0);
+}
+
 void
 bpin(struct buf *b) {
   acquire(&bcache.lock);
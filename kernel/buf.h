@@ -1,6 +1,7 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  int dirty;   // logged, but not yet written to its home block?
   uint dev;
   uint blockno;
   struct sleeplock lock;
@@ -0,0 +1,157 @@
+//
+// Directory name lookup cache: remembers what dirlookup()
+// found for a (directory, name) pair, so that namex() need
+// not read through the directory again for every path
+// element of every open, exec and chdir.
+//
+// An entry with inum 0 is negative: the name is known to be
+// absent from the directory.  Entries are only correct while
+// everything that changes a directory updates them, under
+// that directory's inode lock: dirlink() and sys_unlink().
+// create() and sys_unlink() also drop all entries of a
+// directory whose inode is created or removed, since its
+// inode number may be reused.
+//
+// The cache is NDCACHE entries in sets of DWAYS; a full set
+// reuses its least recently used entry.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "fs.h"
+
+#define DWAYS   4
+#define NDSET   (NDCACHE / DWAYS)
+
+struct dentry {
+  uint dev;
+  uint dir;             // inode number of the directory
+  char name[DIRSIZ];
+  uint inum;            // 0 if name is not in dir
+  uint off;             // of name's dirent in dir
+  uint64 used;          // last use; 0 if the entry is free
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry set[NDSET][DWAYS];
+  uint64 clock;
+  uint64 hits, neghits, misses;
+} dcache;
+
+void
+dcacheinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+static struct dentry*
+dset(uint dev, uint dir, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev * 31 + dir;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return dcache.set[h % NDSET];
+}
+
+// The entry for name in dir, or 0.
+// Caller must hold dcache.lock.
+static struct dentry*
+dfind(uint dev, uint dir, char *name)
+{
+  struct dentry *d, *s;
+
+  s = dset(dev, dir, name);
+  for(d = s; d < s + DWAYS; d++)
+    if(d->used && d->dev == dev && d->dir == dir &&
+       strncmp(d->name, name, DIRSIZ) == 0)
+      return d;
+  return 0;
+}
+
+// Look for name in the directory dir on dev.
+// Returns 1 and sets *inum (0 if the name is known to be
+// absent) and *off if the cache knows, 0 if it doesn't.
+int
+dcachelookup(uint dev, uint dir, char *name, uint *inum, uint *off)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dev, dir, name)) == 0){
+    dcache.misses++;
+    release(&dcache.lock);
+    return 0;
+  }
+  d->used = ++dcache.clock;
+  if(d->inum)
+    dcache.hits++;
+  else
+    dcache.neghits++;
+  *inum = d->inum;
+  *off = d->off;
+  release(&dcache.lock);
+  return 1;
+}
+
+// Remember that name in dir has inode number inum, with
+// its dirent at off, or is absent if inum is 0.
+void
+dcacheenter(uint dev, uint dir, char *name, uint inum, uint off)
+{
+  struct dentry *d, *s;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dev, dir, name)) == 0){
+    s = dset(dev, dir, name);
+    d = s;
+    for(s++; s < d + DWAYS; s++)
+      if(s->used < d->used)
+        d = s;
+    d->dev = dev;
+    d->dir = dir;
+    strncpy(d->name, name, DIRSIZ);
+  }
+  d->inum = inum;
+  d->off = off;
+  d->used = ++dcache.clock;
+  release(&dcache.lock);
+}
+
+// Forget every entry of directory dir.
+void
+dcachepurge(uint dev, uint dir)
+{
+  struct dentry *d;
+  int i;
+
+  acquire(&dcache.lock);
+  for(i = 0; i < NDSET; i++)
+    for(d = dcache.set[i]; d < dcache.set[i] + DWAYS; d++)
+      if(d->used && d->dev == dev && d->dir == dir)
+        d->used = 0;
+  release(&dcache.lock);
+}
+
+// Print hit rates (for ^P).
+void
+dcachedump(void)
+{
+  uint64 hits, neghits, misses, total;
+
+  acquire(&dcache.lock);
+  hits = dcache.hits;
+  neghits = dcache.neghits;
+  misses = dcache.misses;
+  release(&dcache.lock);
+
+  total = hits + neghits + misses;
+  printf("dcache: %ld lookups, %ld%% hits, %ld%% negative hits\n", total,
+         total ? hits * 100 / total : 0, total ? neghits * 100 / total : 0);
+}
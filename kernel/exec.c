@@ -83,7 +83,8 @@ exec(char *path, char **argv)
   if((sz1 = uvmalloc(pagetable, sz, sz + (USERSTACK+1)*PGSIZE, PTE_W)) == 0)
     goto bad;
   sz = sz1;
-  uvmclear(pagetable, sz-(USERSTACK+1)*PGSIZE);
+  if(uvmclear(pagetable, sz-(USERSTACK+1)*PGSIZE) < 0)
+    goto bad;
   sp = sz;
   stackbase = sp - USERSTACK*PGSIZE;
 
@@ -120,6 +121,9 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
     
+  // The ring and its worker belong to the old image.
+  ioring_free(p);
+
   // Commit to the user image.
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
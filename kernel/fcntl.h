@@ -3,3 +3,12 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+#define O_NONBLOCK 0x800
+
+// fcntl() commands
+#define F_GETFL   3  // return O_RDONLY/O_WRONLY/O_RDWR and O_NONBLOCK
+#define F_SETFL   4  // set O_NONBLOCK from the argument
+
+// returned, negated, by a read or write of an O_NONBLOCK
+// pipe or console that would have had to wait.
+#define EAGAIN    11
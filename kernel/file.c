@@ -12,17 +12,24 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "poll.h"
+#include "fcntl.h"
+#include "uio.h"
+#include "slab.h"
 
 struct devsw devsw[NDEV];
+// File structures come from a slab cache, so there are as
+// many as there is memory for.  ftable.lock protects ref.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct kcache cache;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  kcacheinit(&ftable.cache, "file", sizeof(struct file));
 }
 
 // Allocate a file structure.
@@ -31,16 +38,11 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = kcachealloc(&ftable.cache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -72,6 +74,7 @@ fileclose(struct file *f)
   f->ref = 0;
   f->type = FD_NONE;
   release(&ftable.lock);
+  kcachefree(&ftable.cache, f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -101,82 +104,426 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
-// Read from file f.
-// addr is a user virtual address.
+// Read from inode file f at *off into the iovcnt
+// buffers in iov, advancing *off.
+static int
+inoderead(struct file *f, int user_dst, struct iovec *iov, int iovcnt, uint *off)
+{
+  int i, r = 0, tot = 0;
+
+  ilock(f->ip);
+  for(i = 0; i < iovcnt; i++){
+    r = readi(f->ip, user_dst, (uint64)iov[i].iov_base, *off, iov[i].iov_len);
+    if(r > 0){
+      *off += r;
+      tot += r;
+    }
+    if(r != iov[i].iov_len)
+      break;  // end of file or bad address
+  }
+  iunlock(f->ip);
+
+  return (r < 0 && tot == 0) ? -1 : tot;
+}
+
+// Log blocks a transaction that writes n bytes to a file
+// must reserve: a data block and an allocation block for
+// each block of data, the i-node, an indirect block, and
+// 2 blocks of slop for non-aligned writes.
+static int
+writeblocks(int n)
+{
+  return (n + BSIZE - 1) / BSIZE * 2 + 1 + 1 + 2;
+}
+
+// Write the iovcnt buffers in iov to inode file f at *off,
+// advancing *off.  The buffers go into the file back to
+// back, so a batch of small writes shares one log
+// transaction instead of committing once per buffer.
+static int
+inodewrite(struct file *f, int user_src, struct iovec *iov, int iovcnt, uint *off)
+{
+  // write as many blocks at a time as one transaction
+  // may reserve, but reserve only what is left to write.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  int max = ((log_opmax()-1-1-2) / 2) * BSIZE;
+  int i = 0, j, done = 0, tot = 0;
+  int room, n1, r;
+  uint64 left;
+
+  while(i < iovcnt){
+    left = iov[i].iov_len - done;
+    for(j = i + 1; j < iovcnt && left < max; j++)
+      left += iov[j].iov_len;
+    begin_opn(writeblocks(left < max ? left : max));
+    ilock(f->ip);
+    for(room = max; i < iovcnt && room > 0; ){
+      n1 = iov[i].iov_len - done;
+      if(n1 > room)
+        n1 = room;
+      if((r = writei(f->ip, user_src, (uint64)iov[i].iov_base + done, *off, n1)) > 0){
+        *off += r;
+        tot += r;
+      }
+      if(r != n1){
+        // error from writei
+        iunlock(f->ip);
+        end_op();
+        return -1;
+      }
+      room -= n1;
+      done += n1;
+      if(done == iov[i].iov_len){
+        i++;
+        done = 0;
+      }
+    }
+    iunlock(f->ip);
+    end_op();
+  }
+
+  return tot;
+}
+
+// Read from file f into the iovcnt buffers in iov.
+// If off is negative, read at f->off and advance it;
+// otherwise read at off, which only files have.
+// If user_dst==1, then the buffers are user virtual addresses;
+// otherwise, they are kernel addresses.
 int
-fileread(struct file *f, uint64 addr, int n)
+filereadv(struct file *f, int user_dst, struct iovec *iov, int iovcnt, int off)
 {
-  int r = 0;
+  int i, r, tot;
+  uint o;
 
   if(f->readable == 0)
     return -1;
 
-  if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
-    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
-      return -1;
-    r = devsw[f->major].read(1, addr, n);
-  } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
-  } else {
-    panic("fileread");
+  if(f->type == FD_INODE){
+    if(off < 0)
+      return inoderead(f, user_dst, iov, iovcnt, &f->off);
+    o = off;
+    return inoderead(f, user_dst, iov, iovcnt, &o);
   }
+  if(off >= 0)
+    return -1;
 
-  return r;
+  // a pipe or device: go on to the next buffer
+  // only while more is there without waiting.
+  tot = 0;
+  for(i = 0; i < iovcnt; i++){
+    if(iov[i].iov_len == 0)
+      continue;
+    if(f->type == FD_PIPE){
+      r = piperead(f->pipe, user_dst, (uint64)iov[i].iov_base, iov[i].iov_len, f->nonblock);
+    } else if(f->type == FD_DEVICE){
+      if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
+        return -1;
+      r = devsw[f->major].read(user_dst, (uint64)iov[i].iov_base, iov[i].iov_len, f->nonblock);
+    } else {
+      panic("fileread");
+    }
+    if(r < 0)
+      return tot > 0 ? tot : r;
+    tot += r;
+    if(r < iov[i].iov_len || f->type != FD_PIPE || pipeavail(f->pipe) == 0)
+      break;
+  }
+  return tot;
 }
 
-// Write to file f.
-// addr is a user virtual address.
+// Write the iovcnt buffers in iov to file f.
+// If off is negative, write at f->off and advance it;
+// otherwise write at off, which only files have.
+// If user_src==1, then the buffers are user virtual addresses;
+// otherwise, they are kernel addresses.
 int
-filewrite(struct file *f, uint64 addr, int n)
+filewritev(struct file *f, int user_src, struct iovec *iov, int iovcnt, int off)
 {
-  int r, ret = 0;
+  int i, r, tot;
+  uint o;
 
   if(f->writable == 0)
     return -1;
 
-  if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
-    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
+  if(f->type == FD_INODE){
+    if(off < 0)
+      return inodewrite(f, user_src, iov, iovcnt, &f->off);
+    o = off;
+    return inodewrite(f, user_src, iov, iovcnt, &o);
+  }
+  if(off >= 0)
+    return -1;
+
+  tot = 0;
+  for(i = 0; i < iovcnt; i++){
+    if(iov[i].iov_len == 0)
+      continue;
+    if(f->type == FD_PIPE){
+      r = pipewrite(f->pipe, user_src, (uint64)iov[i].iov_base, iov[i].iov_len, f->nonblock);
+    } else if(f->type == FD_DEVICE){
+      if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
+        return -1;
+      r = devsw[f->major].write(user_src, (uint64)iov[i].iov_base, iov[i].iov_len);
+    } else {
+      panic("filewrite");
+    }
+    if(r < 0)
+      return tot > 0 ? tot : r;
+    tot += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  return tot;
+}
+
+// Read from file f.
+// If user_dst==1, then addr is a user virtual address;
+// otherwise, addr is a kernel address.
+int
+fileread(struct file *f, int user_dst, uint64 addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return filereadv(f, user_dst, &iov, 1, -1);
+}
+
+// Write to file f.
+// If user_src==1, then addr is a user virtual address;
+// otherwise, addr is a kernel address.
+int
+filewrite(struct file *f, int user_src, uint64 addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return filewritev(f, user_src, &iov, 1, -1);
+}
+
+// Move up to n bytes from file in to file out without
+// copying them through user space.  The data goes through
+// one kernel page at a time.  Like read(), this waits only
+// until some data is available from a pipe or device, and
+// then moves whatever is there.  If out is a nonblocking
+// pipe that fills up, what it didn't take goes back to a
+// file in (by moving its offset back); bytes from a pipe or
+// device can't go back, so for those this waits for room.
+// Returns the number of bytes moved, or -1 on error.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  char *buf;
+  int r, w, x, m, tot = 0;
+
+  if(in->readable == 0 || out->writable == 0)
+    return -1;
+  if((buf = kalloc()) == 0)
+    return -1;
+
+  while(tot < n){
+    if(tot > 0 && in->type == FD_DEVICE)
+      break;
+    if(tot > 0 && in->type == FD_PIPE && pipeavail(in->pipe) == 0)
+      break;
+    if(in->type != FD_INODE && out->type == FD_PIPE && out->nonblock &&
+       (pipepoll(out->pipe, 1) & (POLLOUT|POLLERR)) == 0){
+      if(tot == 0)
+        tot = -EAGAIN;
+      break;
+    }
+    m = n - tot;
+    if(m > PGSIZE)
+      m = PGSIZE;
+    if((r = fileread(in, 0, (uint64)buf, m)) <= 0){
+      if(r < 0 && tot == 0)
+        tot = r;
+      break;
+    }
+    w = filewrite(out, 0, (uint64)buf, r);
+    if(w == -EAGAIN)
+      w = 0;
+    if(w >= 0 && w < r && in->type != FD_INODE && out->type == FD_PIPE){
+      if((x = pipewrite(out->pipe, 0, (uint64)buf + w, r - w, 0)) > 0)
+        w += x;
+    }
+    if(w < r){
+      if(in->type == FD_INODE){
+        ilock(in->ip);
+        in->off -= r - (w > 0 ? w : 0);
+        iunlock(in->ip);
+      }
+      if(w > 0)
+        tot += w;
+      else if(tot == 0)
+        tot = w < 0 ? w : -EAGAIN;
+      break;
+    }
+    tot += r;
+  }
+
+  kfree(buf);
+  return tot;
+}
+
+// Lock two different inodes in inode-number order,
+// so that two copies in opposite directions can't deadlock.
+static void
+ilock2(struct inode *a, struct inode *b)
+{
+  if(a->inum > b->inum){
+    struct inode *t = a;
+    a = b;
+    b = t;
+  }
+  ilock(a);
+  ilock(b);
+}
+
+// Copy up to n bytes of file in to file out inside the kernel.
+// in must be a regular file, not a directory.  Reading starts at off, or at in's
+// own offset (which is then advanced, under in's inode lock, as
+// fileread() does) if off is negative.
+// Between two files, the data is copied through the buffer
+// cache, in the same size of log transaction that filewrite()
+// uses.  Otherwise it goes through one kernel page at a time.
+// Returns the number of bytes copied, or -1 on error.
+int
+filesendfile(struct file *out, struct file *in, int off, int n)
+{
+  int r, w, m, max, tot = 0;
+  uint o;
+  char *buf;
+
+  if(in->readable == 0 || out->writable == 0 || in->type != FD_INODE)
+    return -1;
+  // not a directory: ilock2() below would lock it and a file in
+  // inum order, while unlink() locks a directory and then a child.
+  ilock(in->ip);
+  r = in->ip->type;
+  iunlock(in->ip);
+  if(r != T_FILE)
+    return -1;
+  o = off;
+
+  if(out->type == FD_INODE){
+    if(in->ip == out->ip)
       return -1;
-    ret = devsw[f->major].write(1, addr, n);
-  } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
+    max = ((log_opmax()-1-1-2) / 2) * BSIZE;
+    while(tot < n){
+      m = n - tot;
+      if(m > max)
+        m = max;
+      begin_opn(writeblocks(m));
+      ilock2(in->ip, out->ip);
+      if(off < 0)
+        o = in->off;
+      if((r = copyi(out->ip, out->off, in->ip, o, m)) > 0){
+        out->off += r;
+        if(off < 0)
+          in->off += r;
+      }
+      iunlock(in->ip);
+      iunlock(out->ip);
       end_op();
-
-      if(r != n1){
-        // error from writei
+      if(r < 0){
+        if(tot == 0)
+          tot = -1;
         break;
       }
-      i += r;
+      o += r;
+      tot += r;
+      if(r < m)
+        break;
     }
-    ret = (i == n ? n : -1);
   } else {
-    panic("filewrite");
+    if((buf = kalloc()) == 0)
+      return -1;
+    while(tot < n){
+      m = n - tot;
+      if(m > PGSIZE)
+        m = PGSIZE;
+      ilock(in->ip);
+      if(off < 0)
+        o = in->off;
+      r = readi(in->ip, 0, (uint64)buf, o, m);
+      iunlock(in->ip);
+      if(r <= 0)
+        break;
+      // a nonblocking pipe may take only part of it.
+      w = filewrite(out, 0, (uint64)buf, r);
+      if(w > 0){
+        if(off < 0){
+          ilock(in->ip);
+          in->off += w;
+          iunlock(in->ip);
+        }
+        o += w;
+        tot += w;
+      }
+      if(w < r){
+        if(w < 0 && tot == 0)
+          tot = w;
+        break;
+      }
+    }
+    kfree(buf);
   }
 
-  return ret;
+  return tot;
 }
 
+// Return which of the poll() events (plus POLLERR and
+// POLLHUP, which are always reported) are ready on file f.
+int
+filepoll(struct file *f, int events)
+{
+  int r;
+
+  if(f->type == FD_PIPE){
+    r = pipepoll(f->pipe, f->writable);
+  } else if(f->type == FD_DEVICE){
+    if(f->major < 0 || f->major >= NDEV)
+      return POLLNVAL;
+    if(devsw[f->major].poll)
+      r = devsw[f->major].poll();
+    else
+      r = POLLIN | POLLOUT;
+  } else {
+    // reads and writes of files never wait.
+    r = POLLIN | POLLOUT;
+  }
+  if(!f->readable)
+    r &= ~POLLIN;
+  if(!f->writable)
+    r &= ~POLLOUT;
+
+  return r & (events | POLLERR | POLLHUP);
+}
+
+// fcntl() on file f.
+int
+filefcntl(struct file *f, int cmd, int arg)
+{
+  int mode;
+
+  switch(cmd){
+  case F_GETFL:
+    if(f->readable && f->writable)
+      mode = O_RDWR;
+    else if(f->writable)
+      mode = O_WRONLY;
+    else
+      mode = O_RDONLY;
+    if(f->nonblock)
+      mode |= O_NONBLOCK;
+    return mode;
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  }
+  return -1;
+}
@@ -3,6 +3,7 @@ struct file {
   int ref; // reference count
   char readable;
   char writable;
+  char nonblock;     // O_NONBLOCK: return -EAGAIN instead of waiting
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
@@ -27,12 +28,16 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+
+  struct inode *hnext;         // itable hash chain; itable.lock
+  struct inode *lprev, *lnext; // itable LRU list, if ref == 0
 };
 
 // map major device number to device functions.
 struct devsw {
-  int (*read)(int, uint64, int);
+  int (*read)(int, uint64, int, int);  // user_dst, dst, n, nonblock
   int (*write)(int, uint64, int);
+  int (*poll)(void);  // ready POLLIN/POLLOUT events; 0 means always ready
 };
 
 extern struct devsw devsw[];
@@ -20,12 +20,30 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "slab.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
 
+// In-memory summaries of the free map and the inode blocks,
+// counted by fsinit(), so that balloc() and ialloc() can skip
+// full blocks.
+// fsum.lock protects the counts and cursors; the bitmap and
+// inode blocks themselves are still protected by their
+// buffers' locks, so a count may be briefly out of date.
+struct {
+  struct spinlock lock;
+  ushort *bfree;     // free blocks in each bitmap block
+  uchar *ifree;      // free inodes in each inode block
+  uint nbmap;        // bitmap blocks
+  uint niblocks;     // inode blocks
+  uint icursor;      // inode block to try first, without groups
+} fsum;
+
+static void fsuminit(int dev);
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -43,7 +61,10 @@ fsinit(int dev) {
   readsb(dev, &sb);
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
+  if(sb.bsize != BSIZE)
+    panic("file system block size is not BSIZE");
   initlog(dev, &sb);
+  fsuminit(dev);
 }
 
 // Zero a block.
@@ -60,33 +81,230 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// The number of bits of bitmap block i that stand
+// for blocks of the disk.
+static int
+bmapbits(uint i)
+{
+  return min(BPB, sb.size - i*BPB);
+}
+
+// The first clear bit of map at or after bit from and
+// before bit n, or -1.  Looks at 64 bits at a time.
+static int
+bitfind(uchar *map, int from, int n)
+{
+  uint64 *w = (uint64*)map, x;
+  int i, bit;
+
+  for(i = from / 64; i*64 < n; i++){
+    x = ~w[i];
+    if(i == from / 64)
+      x &= ~0UL << (from % 64);
+    if(x == 0)
+      continue;
+    for(bit = i*64; (x & 1) == 0; bit++)
+      x >>= 1;
+    return bit < n ? bit : -1;
+  }
+  return -1;
+}
+
+// The number of clear bits among the first n of map.
+static int
+bitcount(uchar *map, int n)
+{
+  int i, c;
+
+  c = 0;
+  for(i = 0; i < n; i++)
+    if((map[i/8] & (1 << (i%8))) == 0)
+      c++;
+  return c;
+}
+
+// Count the free blocks and inodes, for fsum.
+static void
+fsuminit(int dev)
+{
+  struct buf *bp;
+  struct dinode *dip;
+  uint i, inum;
+  int order;
+
+  initlock(&fsum.lock, "fsum");
+  fsum.nbmap = (sb.size + BPB - 1) / BPB;
+  fsum.niblocks = (sb.ninodes + IPB - 1) / IPB;
+  if(sb.datastart == 0)   // made before allocation groups
+    sb.datastart = sb.bmapstart + fsum.nbmap;
+  for(order = 0; order < MAXORDER; order++)
+    if((PGSIZE << order) >= fsum.nbmap*sizeof(ushort) + fsum.niblocks)
+      break;
+  if((fsum.bfree = kalloc_order(order)) == 0)
+    panic("fsuminit");
+  fsum.ifree = (uchar*)(fsum.bfree + fsum.nbmap);
+
+  for(i = 0; i < fsum.nbmap; i++){
+    bp = bread(dev, sb.bmapstart + i);
+    fsum.bfree[i] = bitcount(bp->data, bmapbits(i));
+    brelse(bp);
+  }
+  for(i = 0; i < fsum.niblocks; i++){
+    bp = bread(dev, sb.inodestart + i);
+    fsum.ifree[i] = 0;
+    for(inum = i*IPB; inum < (i+1)*IPB && inum < sb.ninodes; inum++){
+      dip = (struct dinode*)bp->data + inum%IPB;
+      if(inum > 0 && dip->type == 0)
+        fsum.ifree[i]++;
+    }
+    brelse(bp);
+  }
+}
+
+// Reserved windows: a file being written sequentially
+// gets the RESVBLOCKS blocks after its last new one set
+// aside, so that other files' blocks don't land between
+// its blocks.  Windows are only kept in memory, and are
+// dropped when the inode's last reference goes.
+#define NRESV       32
+#define RESVBLOCKS  16
+
+struct {
+  struct inode *ip;   // 0 if unused; fsum.lock
+  uint start, end;    // blocks [start, end)
+} resv[NRESV];
+int resvnext;         // next entry to take over if all are used
+
+// If b is in another inode's window than ip's, return
+// the end of that window, else 0.
+static uint
+resvend(uint b, struct inode *ip)
+{
+  int i;
+  uint end;
+
+  end = 0;
+  acquire(&fsum.lock);
+  for(i = 0; i < NRESV; i++){
+    if(resv[i].ip && resv[i].ip != ip && resv[i].start <= b && b < resv[i].end){
+      end = resv[i].end;
+      break;
+    }
+  }
+  release(&fsum.lock);
+  return end;
+}
+
+// Give ip the window after block b, which it just got.
+static void
+resvset(struct inode *ip, uint b)
+{
+  int i, e;
+
+  acquire(&fsum.lock);
+  e = -1;
+  for(i = 0; i < NRESV; i++){
+    if(resv[i].ip == ip){
+      e = i;
+      break;
+    }
+    if(resv[i].ip == 0 && e < 0)
+      e = i;
+  }
+  if(e < 0){
+    e = resvnext;
+    resvnext = (resvnext + 1) % NRESV;
+  }
+  resv[e].ip = ip;
+  resv[e].start = b + 1;
+  resv[e].end = b + 1 + RESVBLOCKS;
+  release(&fsum.lock);
+}
+
+static void
+resvdrop(struct inode *ip)
+{
+  int i;
+
+  acquire(&fsum.lock);
+  for(i = 0; i < NRESV; i++)
+    if(resv[i].ip == ip)
+      resv[i].ip = 0;
+  release(&fsum.lock);
+}
+
+// The inode's allocation group.
+static uint
+igroup(uint inum)
+{
+  if(sb.ngroups <= 1)
+    return 0;
+  return (uint64)inum * sb.ngroups / sb.ninodes;
+}
+
+// Allocate a zeroed disk block for ip: the first free one
+// at or after goal, wrapping around, that isn't in another
+// inode's window.  Failing that, any free one.
 // returns 0 if out of disk space.
 static uint
-balloc(uint dev)
+balloc(uint dev, uint goal, struct inode *ip)
 {
-  int b, bi, m;
+  int bi, from, pass;
+  uint i, k, b, end;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
+  if(goal >= sb.size)
+    goal = 0;
+  for(pass = 0; pass < 2; pass++){
+    i = goal / BPB;
+    from = goal % BPB;
+    for(k = 0; k <= fsum.nbmap; k++, i = (i + 1) % fsum.nbmap, from = 0){
+      if(fsum.bfree[i] == 0)
+        continue;
+      bp = bread(dev, sb.bmapstart + i);
+      while((bi = bitfind(bp->data, from, bmapbits(i))) >= 0){
+        b = i*BPB + bi;
+        if(pass == 0 && (end = resvend(b, ip)) != 0){
+          from = end - i*BPB;
+          continue;
+        }
+        bp->data[bi/8] |= 1 << (bi % 8);  // Mark block in use.
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+        acquire(&fsum.lock);
+        fsum.bfree[i]--;
+        release(&fsum.lock);
+        bzero(dev, b);
+        return b;
       }
+      brelse(bp);
     }
-    brelse(bp);
   }
   printf("balloc: out of blocks\n");
   return 0;
 }
 
+// Allocate block bn of ip, after block prev of the file
+// (0 if none): right after it if possible, and else in
+// ip's allocation group.  Regular files written in order
+// keep a reserved window ahead of their last block.
+static uint
+bnew(struct inode *ip, uint prev)
+{
+  uint goal, b;
+
+  if(prev)
+    goal = prev + 1;
+  else if(sb.ngroups > 1)
+    goal = sb.datastart + igroup(ip->inum) * sb.groupsize;
+  else
+    goal = sb.datastart;
+  b = balloc(ip->dev, goal, ip);
+  if(b && ip->type == T_FILE)
+    resvset(ip, b);
+  return b;
+}
+
 // Free a disk block.
 static void
 bfree(int dev, uint b)
@@ -101,7 +319,11 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+  log_revoke(b);  // before another balloc() can hand out b
   brelse(bp);
+  acquire(&fsum.lock);
+  fsum.bfree[b / BPB]++;
+  release(&fsum.lock);
 }
 
 // Inodes.
@@ -129,18 +351,22 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in table: an entry in the inode table
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
-//   creates a table entry and increments its ref; iput()
-//   decrements ref.
+// * Referencing in table: the inode table is a hash table
+//   of entries allocated from a slab cache as needed.
+//   ip->ref tracks the number of in-memory pointers to the
+//   entry (open files and current directories). iget()
+//   finds or creates a table entry and increments its ref;
+//   iput() decrements ref.  An entry whose ref reaches zero
+//   stays in the table, on an LRU list, so that using the
+//   inode again needn't read the disk; iget() reuses the
+//   least recently used one once the table has itable.max
+//   entries, a number set from the amount of memory.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   table entry is only correct when ip->valid is 1.
 //   ilock() reads the inode from
 //   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ip->valid when it frees the inode on disk.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -164,8 +390,8 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
+// The itable.lock spin-lock protects the hash chains and the
+// LRU list. Since ip->ref decides when an entry may be reused,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold itable.lock while using any of those fields.
 //
@@ -173,44 +399,138 @@ bfree(int dev, uint b)
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define IMEMFRAC  64  // the inode table may use 1/IMEMFRAC of memory
+
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct kcache cache;
+  struct inode **hash;  // chains of entries, by dev and inum
+  uint nhash;           // a power of two
+  struct inode lru;     // head of the ref == 0 entries, newest first
+  uint n;               // entries allocated
+  uint max;             // most entries to allocate
 } itable;
 
+#define IHASH(dev, inum)  (((inum) ^ (dev) * 31) & (itable.nhash - 1))
+
 void
 iinit()
 {
-  int i = 0;
-  
+  int order;
+
   initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
-  }
+  kcacheinit(&itable.cache, "inode", sizeof(struct inode));
+  itable.lru.lprev = itable.lru.lnext = &itable.lru;
+
+  // about four entries per hash chain.
+  itable.max = kfreepages() * PGSIZE / IMEMFRAC / sizeof(struct inode);
+  for(order = 0; order < MAXORDER; order++)
+    if((PGSIZE << order) / sizeof(struct inode*) >= itable.max / 4)
+      break;
+  if((itable.hash = kalloc_order(order)) == 0)
+    panic("iinit");
+  memset(itable.hash, 0, PGSIZE << order);
+  itable.nhash = (PGSIZE << order) / sizeof(struct inode*);
+}
+
+static void
+lruremove(struct inode *ip)
+{
+  ip->lprev->lnext = ip->lnext;
+  ip->lnext->lprev = ip->lprev;
+}
+
+// Remove ip from the table.
+// Caller must hold itable.lock.
+static void
+iunhash(struct inode *ip)
+{
+  struct inode **pp;
+
+  for(pp = &itable.hash[IHASH(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->hnext)
+    ;
+  *pp = ip->hnext;
+}
+
+// Take the least recently used entry with ref == 0 out of
+// the table, for reuse.  Returns 0 if there is none.
+// Caller must hold itable.lock.
+static struct inode*
+ievict(void)
+{
+  struct inode *ip;
+
+  ip = itable.lru.lprev;
+  if(ip == &itable.lru)
+    return 0;
+  lruremove(ip);
+  iunhash(ip);
+  return ip;
 }
 
 static struct inode* iget(uint dev, uint inum);
 
-// Allocate an inode on device dev.
+// The first inode block of the allocation group in which
+// to put a new inode of the given type, made in the
+// directory with inode number parent: the parent's own
+// group for files, the group with the most free inodes
+// for directories, to spread the tree out.
+static uint
+igroupblock(short type, uint parent)
+{
+  uint g, best, i, n, most;
+
+  if(sb.ngroups <= 1)
+    return fsum.icursor;
+  g = igroup(parent);
+  if(type == T_DIR){
+    most = 0;
+    for(best = 0; best < sb.ngroups; best++){
+      n = 0;
+      for(i = 0; i < fsum.niblocks; i++)
+        if(igroup(i*IPB) == best)
+          n += fsum.ifree[i];
+      if(n > most){
+        most = n;
+        g = best;
+      }
+    }
+  }
+  return (uint64)g * sb.ninodes / sb.ngroups / IPB;
+}
+
+// Allocate an inode on device dev, in the directory with
+// inode number parent.
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode,
 // or NULL if there is no free inode.
 struct inode*
-ialloc(uint dev, short type)
+ialloc(uint dev, short type, uint parent)
 {
-  int inum;
+  uint i, k, inum;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
-    bp = bread(dev, IBLOCK(inum, sb));
-    dip = (struct dinode*)bp->data + inum%IPB;
-    if(dip->type == 0){  // a free inode
-      memset(dip, 0, sizeof(*dip));
-      dip->type = type;
-      log_write(bp);   // mark it allocated on the disk
-      brelse(bp);
-      return iget(dev, inum);
+  // only look in inode blocks with free inodes,
+  // starting in the group chosen for it.
+  i = igroupblock(type, parent) % fsum.niblocks;
+  for(k = 0; k < fsum.niblocks; k++, i = (i + 1) % fsum.niblocks){
+    if(fsum.ifree[i] == 0)
+      continue;
+    bp = bread(dev, sb.inodestart + i);
+    for(inum = i*IPB; inum < (i+1)*IPB && inum < sb.ninodes; inum++){
+      dip = (struct dinode*)bp->data + inum%IPB;
+      if(inum > 0 && dip->type == 0){  // a free inode
+        memset(dip, 0, sizeof(*dip));
+        dip->type = type;
+        log_write(bp);   // mark it allocated on the disk
+        brelse(bp);
+        acquire(&fsum.lock);
+        fsum.ifree[i]--;
+        fsum.icursor = i;
+        release(&fsum.lock);
+        return iget(dev, inum);
+      }
     }
     brelse(bp);
   }
@@ -246,31 +566,39 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **hp;
 
   acquire(&itable.lock);
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  hp = &itable.hash[IHASH(dev, inum)];
+  for(ip = *hp; ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        lruremove(ip);
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
+  // Add a new inode to the table, reusing the least
+  // recently used one if the table is big enough,
+  // or if there's no memory for another.
+  ip = 0;
+  if(itable.n >= itable.max)
+    ip = ievict();
+  if(ip == 0 && (ip = kcachealloc(&itable.cache)) != 0)
+    itable.n++;
+  if(ip == 0 && (ip = ievict()) == 0)
     panic("iget: no inodes");
-
-  ip = empty;
+  memset(ip, 0, sizeof(*ip));
+  initsleeplock(&ip->lock, "inode");
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->hnext = *hp;
+  *hp = ip;
   release(&itable.lock);
 
   return ip;
@@ -327,8 +655,8 @@ iunlock(struct inode *ip)
 }
 
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode table entry can
-// be recycled.
+// If that was the last reference, the inode table keeps
+// the entry for reuse, unless ip is not valid.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -351,13 +679,28 @@ iput(struct inode *ip)
     ip->type = 0;
     iupdate(ip);
     ip->valid = 0;
+    acquire(&fsum.lock);
+    fsum.ifree[ip->inum / IPB]++;
+    release(&fsum.lock);
 
     releasesleep(&ip->lock);
 
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0){
+    resvdrop(ip);
+    if(ip->valid){
+      ip->lnext = itable.lru.lnext;
+      ip->lprev = &itable.lru;
+      itable.lru.lnext->lprev = ip;
+      itable.lru.lnext = ip;
+    } else {
+      iunhash(ip);
+      kcachefree(&itable.cache, ip);
+      itable.n--;
+    }
+  }
   release(&itable.lock);
 }
 
@@ -387,7 +730,7 @@ bmap(struct inode *ip, uint bn)
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0){
-      addr = balloc(ip->dev);
+      addr = bnew(ip, bn > 0 ? ip->addrs[bn-1] : 0);
       if(addr == 0)
         return 0;
       ip->addrs[bn] = addr;
@@ -399,7 +742,9 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0){
-      addr = balloc(ip->dev);
+      // right after the last direct block, ahead of the
+      // blocks it will list.
+      addr = bnew(ip, ip->addrs[NDIRECT-1]);
       if(addr == 0)
         return 0;
       ip->addrs[NDIRECT] = addr;
@@ -407,7 +752,7 @@ bmap(struct inode *ip, uint bn)
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      addr = balloc(ip->dev);
+      addr = bnew(ip, bn > 0 ? a[bn-1] : ip->addrs[NDIRECT]);
       if(addr){
         a[bn] = addr;
         log_write(bp);
@@ -538,16 +883,290 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   return tot;
 }
 
+// Copy n bytes from inode src at offset soff to inode dst at
+// offset doff, one block at a time straight out of src's
+// buffer-cache blocks.  src and dst must be different inodes.
+// Caller must hold both locks and be inside a transaction
+// big enough for the blocks written.
+// Returns the number of bytes copied, which is less than n
+// at the end of src or if dst runs out of disk, or -1 if
+// nothing could be written at doff.
+int
+copyi(struct inode *dst, uint doff, struct inode *src, uint soff, uint n)
+{
+  uint tot, m, addr;
+  int r;
+  struct buf *bp;
+
+  if(src == dst)
+    panic("copyi");
+  if(soff > src->size || soff + n < soff)
+    return 0;
+  if(soff + n > src->size)
+    n = src->size - soff;
+
+  for(tot=0; tot<n; tot+=m, soff+=m, doff+=m){
+    if((addr = bmap(src, soff/BSIZE)) == 0)
+      break;
+    bp = bread(src->dev, addr);
+    m = min(n - tot, BSIZE - soff%BSIZE);
+    r = writei(dst, 0, (uint64)(bp->data + soff%BSIZE), doff, m);
+    brelse(bp);
+    if(r != m){
+      if(r < 0)
+        return tot > 0 ? tot : -1;
+      tot += r;
+      break;
+    }
+  }
+  return tot;
+}
+
 // Directories
 
+#define DPB  (BSIZE / sizeof(struct dirent))  // dirents per block
+
 int
 namecmp(const char *s, const char *t)
 {
   return strncmp(s, t, DIRSIZ);
 }
 
+// Hashed directories (see fs.h).
+
+static void
+sorthash(uint *h, int n)
+{
+  int i, j;
+  uint x;
+
+  for(i = 1; i < n; i++){
+    x = h[i];
+    for(j = i; j > 0 && h[j-1] > x; j--)
+      h[j] = h[j-1];
+    h[j] = x;
+  }
+}
+
+// The slot of the index in b0, block 0 of a hashed
+// directory, that covers hash h.
+static int
+dxfind(struct buf *b0, uint h)
+{
+  struct dxentry *dx = (struct dxentry*)b0->data + 2;
+  int i;
+
+  for(i = 1; i < NDX && dx[i].block != 0 && dx[i].hash <= h; i++)
+    ;
+  return i - 1;
+}
+
+// Look for name in slots lo up to hi of bp, block fbn of
+// a directory.  Returns its inum and sets *poff, or
+// returns 0.
+static uint
+dirscan(struct buf *bp, uint fbn, int lo, int hi, char *name, uint *poff)
+{
+  struct dirent *de = (struct dirent*)bp->data;
+  int i;
+
+  for(i = lo; i < hi; i++){
+    if(de[i].inum != 0 && namecmp(name, de[i].name) == 0){
+      *poff = fbn*BSIZE + i*sizeof(struct dirent);
+      return de[i].inum;
+    }
+  }
+  return 0;
+}
+
+// Put (name, inum) in a free slot of directory block bp.
+// Returns the slot, or -1 if the block is full.
+static int
+dirput(struct buf *bp, char *name, uint inum)
+{
+  struct dirent *de = (struct dirent*)bp->data;
+  int i;
+
+  for(i = 0; i < DPB; i++){
+    if(de[i].inum == 0){
+      strncpy(de[i].name, name, DIRSIZ);
+      de[i].inum = inum;
+      log_write(bp);
+      return i;
+    }
+  }
+  return -1;
+}
+
+// dirlookup() for a hashed directory: look at "." and ".."
+// in block 0, then in the one block that can hold name.
+static uint
+dxlookup(struct inode *dp, char *name, uint *poff)
+{
+  struct buf *bp;
+  uint inum, fbn;
+
+  bp = bread(dp->dev, bmap(dp, 0));
+  inum = dirscan(bp, 0, 0, 2, name, poff);
+  fbn = ((struct dxentry*)bp->data + 2)[dxfind(bp, dirhash(name))].block;
+  brelse(bp);
+  if(inum)
+    return inum;
+
+  bp = bread(dp->dev, bmap(dp, fbn));
+  inum = dirscan(bp, fbn, 0, DPB, name, poff);
+  brelse(bp);
+  return inum;
+}
+
+// Turn dp, a linear directory of one full block, into a
+// hashed one whose names are split over two new blocks.
+// Returns 0, or -1 if it can't.
+static int
+dxconvert(struct inode *dp)
+{
+  struct buf *b0, *b1, *b2;
+  struct dirent *de, *d1, *d2;
+  struct dxentry *dx;
+  uint *h, split, a1, a2;
+  int i, n;
+
+  // too big for the kernel stack with 4 KB blocks.
+  if((h = kalloc()) == 0)
+    return -1;
+  b0 = bread(dp->dev, bmap(dp, 0));
+  de = (struct dirent*)b0->data;
+  if(namecmp(de[0].name, ".") != 0 || namecmp(de[1].name, "..") != 0 ||
+     (a1 = bmap(dp, 1)) == 0 || (a2 = bmap(dp, 2)) == 0){
+    brelse(b0);
+    kfree(h);
+    return -1;
+  }
+
+  n = 0;
+  for(i = 2; i < DPB; i++)
+    if(de[i].inum != 0)
+      h[n++] = dirhash(de[i].name);
+  sorthash(h, n);
+  split = n > 0 ? h[n/2] : 0;
+  kfree(h);
+
+  b1 = bread(dp->dev, a1);
+  b2 = bread(dp->dev, a2);
+  d1 = (struct dirent*)b1->data;
+  d2 = (struct dirent*)b2->data;
+  for(i = 2; i < DPB; i++){
+    if(de[i].inum == 0)
+      continue;
+    if(dirhash(de[i].name) < split)
+      *d1++ = de[i];
+    else
+      *d2++ = de[i];
+  }
+  memset(&de[2], 0, BSIZE - 2*sizeof(*de));
+  dx = (struct dxentry*)b0->data + 2;
+  dx[0].hash = 0;
+  dx[0].block = 1;
+  dx[1].hash = split;
+  dx[1].block = 2;
+  log_write(b0);
+  log_write(b1);
+  log_write(b2);
+  brelse(b2);
+  brelse(b1);
+  brelse(b0);
+
+  dp->size = 3*BSIZE;
+  dp->major = DIRHASH;
+  iupdate(dp);
+  dcachepurge(dp->dev, dp->inum);
+  return 0;
+}
+
+// dirlink() for a hashed directory.  If the block for name
+// is full, split it at its median hash into a new block.
+static int
+dxlink(struct inode *dp, char *name, uint inum)
+{
+  struct buf *b0, *bp, *nbp;
+  struct dxentry *dx;
+  struct dirent *de, *nde;
+  uint *h, hash, split, fbn, nfbn, addr;
+  int i, j, n, slot;
+
+  hash = dirhash(name);
+  b0 = bread(dp->dev, bmap(dp, 0));
+  dx = (struct dxentry*)b0->data + 2;
+  i = dxfind(b0, hash);
+  fbn = dx[i].block;
+  bp = bread(dp->dev, bmap(dp, fbn));
+  if((slot = dirput(bp, name, inum)) >= 0)
+    goto done;
+
+  // Split at the median, or at the next hash up if the
+  // lower half all has the block's lowest hash.
+  if((h = kalloc()) == 0)
+    goto bad;
+  de = (struct dirent*)bp->data;
+  for(j = 0; j < DPB; j++)
+    h[j] = dirhash(de[j].name);
+  sorthash(h, DPB);
+  for(j = DPB/2; j < DPB && h[j] == dx[i].hash; j++)
+    ;
+  split = j < DPB ? h[j] : 0;
+  kfree(h);
+  for(n = i + 1; n < NDX && dx[n].block != 0; n++)
+    ;
+  nfbn = dp->size / BSIZE;
+  if(j == DPB || n == NDX || nfbn >= MAXFILE || (addr = bmap(dp, nfbn)) == 0)
+    goto bad;
+
+  nbp = bread(dp->dev, addr);
+  nde = (struct dirent*)nbp->data;
+  for(j = 0; j < DPB; j++){
+    if(dirhash(de[j].name) >= split){
+      *nde++ = de[j];
+      memset(&de[j], 0, sizeof(de[j]));
+    }
+  }
+  memmove(&dx[i+2], &dx[i+1], (n - i - 1) * sizeof(*dx));
+  memset(&dx[i+1], 0, sizeof(*dx));
+  dx[i+1].hash = split;
+  dx[i+1].block = nfbn;
+  log_write(b0);
+  log_write(bp);
+  log_write(nbp);
+  dp->size += BSIZE;
+  iupdate(dp);
+  // names moved, so their cached offsets are wrong.
+  dcachepurge(dp->dev, dp->inum);
+
+  if(hash >= split){
+    brelse(bp);
+    bp = nbp;
+    fbn = nfbn;
+  } else {
+    brelse(nbp);
+  }
+  if((slot = dirput(bp, name, inum)) < 0)
+    goto bad;
+
+done:
+  dcacheenter(dp->dev, dp->inum, name, inum, fbn*BSIZE + slot*sizeof(struct dirent));
+  brelse(bp);
+  brelse(b0);
+  return 0;
+
+bad:
+  brelse(bp);
+  brelse(b0);
+  return -1;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Caller must hold dp's lock, which keeps the dcache
+// entries for dp correct.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
@@ -557,25 +1176,42 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
-      continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
+  if(dcachelookup(dp->dev, dp->inum, name, &inum, &off)){
+    if(inum == 0)
+      return 0;
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+
+  if(dp->major == DIRHASH){
+    inum = dxlookup(dp, name, &off);
+  } else {
+    inum = 0;
+    for(off = 0; off < dp->size; off += sizeof(de)){
+      if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlookup read");
+      if(de.inum == 0)
+        continue;
+      if(namecmp(name, de.name) == 0){
+        // entry matches path element
+        inum = de.inum;
+        break;
+      }
     }
   }
 
-  return 0;
+  dcacheenter(dp->dev, dp->inum, name, inum, off);
+  if(inum == 0)
+    return 0;
+  if(poff)
+    *poff = off;
+  return iget(dp->dev, inum);
 }
 
 // Write a new directory entry (name, inum) into the directory dp.
-// Returns 0 on success, -1 on failure (e.g. out of disk blocks).
+// Returns 0 on success, -1 on failure (e.g. out of disk blocks,
+// or no room left in a hashed directory's index).
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
@@ -589,6 +1225,9 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
+  if(dp->major == DIRHASH)
+    return dxlink(dp, name, inum);
+
   // Look for an empty dirent.
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
@@ -597,10 +1236,15 @@ dirlink(struct inode *dp, char *name, uint inum)
       break;
   }
 
+  // A full one-block directory becomes a hashed one.
+  if(off == BSIZE && dp->size == BSIZE && dxconvert(dp) == 0)
+    return dxlink(dp, name, inum);
+
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     return -1;
+  dcacheenter(dp->dev, dp->inum, name, inum, off);
 
   return 0;
 }
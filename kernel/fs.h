@@ -3,12 +3,19 @@
 
 
 #define ROOTINO  1   // root i-number
-#define BSIZE 1024  // block size
+#ifndef BSIZE
+#define BSIZE 4096  // block size; make BSIZE=1024 for 1 KB blocks
+#endif
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
 //                                          free bit map | data blocks]
 //
+// The data blocks, and the inodes, are divided evenly into
+// sb.ngroups allocation groups.  The kernel puts a file's
+// data in its inode's group, and a file's inode in its
+// directory's group, so that related blocks are close.
+//
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
 struct superblock {
@@ -20,10 +27,17 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint datastart;    // Block number of first data block
+  uint ngroups;      // Number of allocation groups (0: one)
+  uint groupsize;    // Data blocks per allocation group
+  uint bsize;        // Block size; must be BSIZE
 };
 
 #define FSMAGIC 0x10203040
 
+// Most data blocks the log's one header block can describe.
+#define LOGMAX (BSIZE / sizeof(int) - 3)
+
 #define NDIRECT 12
 #define NINDIRECT (BSIZE / sizeof(uint))
 #define MAXFILE (NDIRECT + NINDIRECT)
@@ -58,3 +72,33 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// A directory that outgrows one block is hashed: its
+// dinode.major is DIRHASH.  Block 0 holds "." and ".." and
+// then an index of up to NDX entries, sorted by hash.  Entry
+// i says that the names whose dirhash() is at least its hash,
+// and less than entry i+1's, are in directory block `block'.
+// Index entries start with a zero inum, so code that reads
+// the directory as plain dirents sees empty slots.
+#define DIRHASH 1
+
+struct dxentry {
+  ushort zero;       // always 0
+  ushort pad;
+  uint hash;         // lowest hash in the block
+  uint block;        // block within the directory; 0 if unused
+  uint pad2;
+};
+
+#define NDX (BSIZE / sizeof(struct dxentry) - 2)
+
+static inline uint
+dirhash(const char *name)
+{
+  uint h = 2166136261;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h;
+}
+
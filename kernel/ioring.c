@@ -0,0 +1,356 @@
+//
+// Asynchronous system calls through a submission/completion
+// ring shared with user space; see ioring.h.
+//
+// One ioring_enter() trap takes a whole batch of submissions.
+// Opens, closes and no-ops change the process's file table,
+// so they are done right away.  Reads, writes and fstats are
+// handed to a kernel worker thread, one per ring, which
+// completes them while the process goes on running.  The
+// worker can't use copyin()/copyout() on behalf of myproc(),
+// so it moves data through a kernel page and the owner's
+// page table, holding vmlock so that the owner's growproc()
+// can't unmap or remap pages under the copy.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "stat.h"
+#include "ioring.h"
+
+struct ioreq {
+  struct io_sqe sqe;
+  struct file *f;   // reference held until the request completes
+};
+
+struct ioctx {
+  struct spinlock lock;
+  struct ioring *ring;   // the shared page
+  struct proc *owner;
+  struct proc *worker;
+  struct sleeplock vmlock;       // owner's mappings may not change
+  struct ioreq q[IORING_NCQE];  // requests for the worker
+  uint qhead, qtail;
+  int inflight;          // requests queued or being worked on
+  int dying;             // owner is in exit() or exec()
+  int done;              // worker has stopped
+};
+
+// Post a completion.  inflight counts requests that will
+// post one later, so there is always room.
+// Caller must hold io->lock.
+static void
+iopost(struct ioctx *io, uint64 data, int res)
+{
+  struct ioring *r = io->ring;
+  struct io_cqe *cqe;
+
+  cqe = &r->cq[r->cqtail % IORING_NCQE];
+  cqe->data = data;
+  cqe->res = res;
+  __sync_synchronize();  // the entry must be visible before cqtail moves
+  r->cqtail++;
+  wakeup(&io->inflight);
+}
+
+// copyout() to the owner's memory, from the worker.
+static int
+iocopyout(struct ioctx *io, uint64 dstva, char *src, uint64 len)
+{
+  int r;
+
+  acquiresleep(&io->vmlock);
+  r = copyout(io->owner->pagetable, dstva, src, len);
+  releasesleep(&io->vmlock);
+  return r;
+}
+
+// copyin() from the owner's memory, from the worker.
+static int
+iocopyin(struct ioctx *io, char *dst, uint64 srcva, uint64 len)
+{
+  int r;
+
+  acquiresleep(&io->vmlock);
+  r = copyin(io->owner->pagetable, dst, srcva, len);
+  releasesleep(&io->vmlock);
+  return r;
+}
+
+// Carry out a read, write or fstat in the worker thread,
+// using buf (a page) to move data to or from the owner.
+static int
+iodo(struct ioctx *io, struct ioreq *req, char *buf)
+{
+  struct file *f = req->f;
+  uint64 addr = req->sqe.addr;
+  int n = req->sqe.n;
+  struct stat st;
+  int r, m, tot;
+
+  switch(req->sqe.op){
+  case IORING_OP_READ:
+    if(n < 0)
+      return -1;
+    tot = 0;
+    while(tot < n){
+      m = n - tot;
+      if(m > PGSIZE)
+        m = PGSIZE;
+      if((r = fileread(f, 0, (uint64)buf, m)) <= 0)
+        return tot > 0 ? tot : r;
+      if(iocopyout(io, addr + tot, buf, r) < 0)
+        return -1;
+      tot += r;
+      // like read(), only files are read until n bytes.
+      if(r < m || f->type != FD_INODE)
+        break;
+    }
+    return tot;
+
+  case IORING_OP_WRITE:
+    if(n < 0)
+      return -1;
+    tot = 0;
+    while(tot < n){
+      m = n - tot;
+      if(m > PGSIZE)
+        m = PGSIZE;
+      if(iocopyin(io, buf, addr + tot, m) < 0)
+        return -1;
+      if((r = filewrite(f, 0, (uint64)buf, m)) != m){
+        if(r > 0)
+          tot += r;
+        return tot > 0 ? tot : r;
+      }
+      tot += m;
+    }
+    return tot;
+
+  case IORING_OP_FSTAT:
+    if(f->type != FD_INODE && f->type != FD_DEVICE)
+      return -1;
+    ilock(f->ip);
+    stati(f->ip, &st);
+    iunlock(f->ip);
+    if(iocopyout(io, addr, (char*)&st, sizeof(st)) < 0)
+      return -1;
+    return 0;
+  }
+  return -1;
+}
+
+// The worker thread for one ring.
+static void
+ioworker(void *arg)
+{
+  struct ioctx *io = arg;
+  struct ioreq req;
+  char *buf;
+  int res;
+
+  buf = kalloc();
+
+  acquire(&io->lock);
+  for(;;){
+    while(io->qhead == io->qtail && !io->dying)
+      sleep(&io->qhead, &io->lock);
+    if(io->dying)
+      break;
+    req = io->q[io->qhead++ % IORING_NCQE];
+    release(&io->lock);
+
+    res = (buf ? iodo(io, &req, buf) : -1);
+    fileclose(req.f);
+
+    acquire(&io->lock);
+    iopost(io, req.sqe.data, res);
+    io->inflight--;
+  }
+  // ioring_free() may free io as soon as done is set.
+  io->done = 1;
+  wakeup(&io->done);
+  release(&io->lock);
+
+  if(buf)
+    kfree(buf);
+}
+
+// Carry out a submission that uses the current
+// process's file table.
+static int
+iosync(struct io_sqe *sqe)
+{
+  char path[MAXPATH];
+
+  switch(sqe->op){
+  case IORING_OP_NOP:
+    return 0;
+  case IORING_OP_OPEN:
+    if(fetchstr(sqe->addr, path, MAXPATH) < 0)
+      return -1;
+    return openpath(path, sqe->n);
+  case IORING_OP_CLOSE:
+    return fdclose(sqe->fd);
+  }
+  return -1;
+}
+
+// Map a ring into the current process at IORING and start
+// its worker.  Returns the ring's user address, or -1.
+uint64
+ioring_setup(void)
+{
+  struct proc *p = myproc();
+  struct ioctx *io;
+  char *mem;
+
+  if(p->io)
+    return IORING;
+  if(sizeof(struct ioring) > PGSIZE || sizeof(struct ioctx) > PGSIZE)
+    panic("ioring_setup: too big");
+
+  if((io = (struct ioctx*)kalloc()) == 0)
+    return -1;
+  if((mem = kalloc()) == 0){
+    kfree(io);
+    return -1;
+  }
+  memset(io, 0, sizeof(*io));
+  memset(mem, 0, PGSIZE);
+  if(mappages(p->pagetable, IORING, PGSIZE, (uint64)mem, PTE_R|PTE_W|PTE_U) < 0){
+    kfree(mem);
+    kfree(io);
+    return -1;
+  }
+  initlock(&io->lock, "ioring");
+  initsleeplock(&io->vmlock, "ioring vm");
+  io->ring = (struct ioring*)mem;
+  io->owner = p;
+  if((io->worker = kthread(ioworker, io, "ioworker")) == 0){
+    uvmunmap(p->pagetable, IORING, 1, 1);
+    kfree(io);
+    return -1;
+  }
+  p->io = io;
+  return IORING;
+}
+
+// Take up to to_submit entries from the submission queue,
+// then wait until at least min_complete completions are
+// waiting to be consumed (or nothing more is in flight).
+// Returns the number of entries taken.
+int
+ioring_enter(int to_submit, int min_complete)
+{
+  struct proc *p = myproc();
+  struct ioctx *io = p->io;
+  struct ioring *r;
+  struct io_sqe sqe;
+  struct file *f;
+  uint head;
+  int n, res;
+
+  if(io == 0)
+    return -1;
+  r = io->ring;
+
+  for(n = 0; n < to_submit; n++){
+    head = r->sqhead;
+    if(head == r->sqtail)
+      break;
+    __sync_synchronize();  // read the entry only after seeing sqtail
+    sqe = r->sq[head % IORING_NSQE];
+
+    acquire(&io->lock);
+    if(r->cqtail - r->cqhead + io->inflight >= IORING_NCQE){
+      // no room for another completion.
+      release(&io->lock);
+      break;
+    }
+    if(sqe.op == IORING_OP_READ || sqe.op == IORING_OP_WRITE ||
+       sqe.op == IORING_OP_FSTAT){
+      if(sqe.fd < 0 || sqe.fd >= NOFILE || (f = p->ofile[sqe.fd]) == 0){
+        iopost(io, sqe.data, -1);
+      } else {
+        io->q[io->qtail % IORING_NCQE].sqe = sqe;
+        io->q[io->qtail % IORING_NCQE].f = filedup(f);
+        io->qtail++;
+        io->inflight++;
+        wakeup(&io->qhead);
+      }
+      release(&io->lock);
+    } else {
+      release(&io->lock);
+      res = iosync(&sqe);
+      acquire(&io->lock);
+      iopost(io, sqe.data, res);
+      release(&io->lock);
+    }
+    r->sqhead = head + 1;
+  }
+
+  acquire(&io->lock);
+  while((int)(r->cqtail - r->cqhead) < min_complete && io->inflight > 0){
+    if(killed(p))
+      break;
+    sleep(&io->inflight, &io->lock);
+  }
+  release(&io->lock);
+
+  return n;
+}
+
+// Keep p's ring worker, if any, away from p's memory
+// while growproc() changes p's mappings.
+void
+ioring_vmlock(struct proc *p)
+{
+  if(p->io)
+    acquiresleep(&p->io->vmlock);
+}
+
+void
+ioring_vmunlock(struct proc *p)
+{
+  if(p->io)
+    releasesleep(&p->io->vmlock);
+}
+
+// Stop p's ring worker and unmap the ring.  Called when p
+// exits or execs, while p's memory and files are still there
+// for the worker to finish with.
+void
+ioring_free(struct proc *p)
+{
+  struct ioctx *io = p->io;
+
+  if(io == 0)
+    return;
+
+  acquire(&io->lock);
+  io->dying = 1;
+  wakeup(&io->qhead);
+  // the worker may be waiting in a pipe or console read.
+  // it can't exit while we hold io->lock, so its pid is good.
+  kill(io->worker->pid);
+  while(!io->done)
+    sleep(&io->done, &io->lock);
+  release(&io->lock);
+
+  // requests the worker never started.
+  while(io->qhead != io->qtail)
+    fileclose(io->q[io->qhead++ % IORING_NCQE].f);
+
+  uvmunmap(p->pagetable, IORING, 1, 1);
+  kfree(io);
+  p->io = 0;
+}
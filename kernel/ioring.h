@@ -0,0 +1,45 @@
+// Submission/completion ring shared between a process
+// and the kernel.  Both the kernel and user programs use
+// this header file.
+//
+// ioring_setup() maps one struct ioring page into the
+// process.  The process fills sq[sqtail % IORING_NSQE] and
+// advances sqtail; ioring_enter() consumes entries from
+// sqhead.  The kernel posts results at cqtail, and the
+// process consumes them from cqhead.
+
+#define IORING_OP_NOP    0
+#define IORING_OP_READ   1  // read(fd, addr, n)
+#define IORING_OP_WRITE  2  // write(fd, addr, n)
+#define IORING_OP_FSTAT  3  // fstat(fd, addr)
+#define IORING_OP_OPEN   4  // open(addr, n)
+#define IORING_OP_CLOSE  5  // close(fd)
+
+#define IORING_NSQE 64
+#define IORING_NCQE 64
+
+// submission queue entry
+struct io_sqe {
+  int op;         // IORING_OP_*
+  int fd;
+  uint64 addr;    // buffer, struct stat, or path
+  int n;          // byte count, or open mode
+  int pad;
+  uint64 data;    // copied to the completion
+};
+
+// completion queue entry
+struct io_cqe {
+  uint64 data;    // from the submission
+  int res;        // what the system call would have returned
+  int pad;
+};
+
+struct ioring {
+  uint sqhead;    // written by the kernel
+  uint sqtail;    // written by the process
+  uint cqhead;    // written by the process
+  uint cqtail;    // written by the kernel
+  struct io_sqe sq[IORING_NSQE];
+  struct io_cqe cq[IORING_NCQE];
+};
@@ -1,6 +1,23 @@
 // Physical memory allocator, for user processes,
-// kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// kernel stacks, page-table pages, pipe buffers
+// and slabs.
+//
+// A buddy allocator: free memory is kept in blocks of
+// 2^order pages, aligned to their size, on one list per
+// order.  kalloc_order() splits a bigger block when its
+// own list is empty, and kfree_order() merges a block with
+// its buddy whenever the buddy is free too.
+//
+// Single pages, by far the most common request, go through
+// a small per-CPU list first, so that kalloc() and kfree()
+// usually take only that CPU's lock.
+//
+// Idle harts keep a pool of pages that are already zeroed,
+// for kalloc_zeroed(); see kzero().
+//
+// At boot, free memory is one range that is only carved
+// into blocks as they are needed (or by the other harts,
+// see kinithart()), so booting does not touch every page.
 
 #include "types.h"
 #include "param.h"
@@ -14,29 +31,273 @@ void freerange(void *pa_start, void *pa_end);
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+#define NPAGES    ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PCPMAX    64   // pages a CPU may hold
+#define PCPBATCH  16   // pages moved to or from a CPU at once
+#define ZPOOLMAX  256  // pre-zeroed pages to keep
+
+#define FREE      0x80  // state[i]: page i starts a free block
+
+// Junk filling costs a memset per page, so it is only
+// done in debug kernels (make KJUNK=1).
+#ifdef KJUNK
+#define JUNK(pa, c, n)  memset((pa), (c), (n))
+#else
+#define JUNK(pa, c, n)
+#endif
+
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct run free[MAXORDER+1];  // heads of circular lists
+  int nfree[MAXORDER+1];        // blocks on each list
+  uchar state[NPAGES];          // FREE | order, for free blocks
+  uint64 lazy, lazyend;         // free pages not yet on a list
 } kmem;
 
+// each CPU's single pages.
+struct {
+  struct spinlock lock;
+  struct run *list;
+  int n;
+} pcp[NCPU];
+
+// pages zeroed by idle harts.  only the first word
+// (the list link) of each is not zero.
+struct {
+  struct spinlock lock;
+  struct run *list;
+  int n;
+} zpool;
+
+#define PAGENO(pa)  (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define PAGE(n)     ((struct run*)(KERNBASE + (uint64)(n) * PGSIZE))
+
 void
 kinit()
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  for(i = 0; i <= MAXORDER; i++)
+    kmem.free[i].next = kmem.free[i].prev = &kmem.free[i];
+  for(i = 0; i < NCPU; i++)
+    initlock(&pcp[i].lock, "kmem_cpu");
+  initlock(&zpool.lock, "kmem_zero");
   freerange(end, (void*)PHYSTOP);
 }
 
+// Put the free block at page n on the list for order.
+// Caller must hold kmem.lock.
+static void
+push(uint64 n, int order)
+{
+  struct run *r = PAGE(n), *h = &kmem.free[order];
+
+  r->next = h->next;
+  r->prev = h;
+  h->next->prev = r;
+  h->next = r;
+  kmem.state[n] = FREE | order;
+  kmem.nfree[order]++;
+}
+
+static void
+pull(uint64 n, int order)
+{
+  struct run *r = PAGE(n);
+
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+  kmem.state[n] = 0;
+  kmem.nfree[order]--;
+}
+
+// Free the block of 2^order pages at page n, merging
+// it with its buddy as far as possible.
+// Caller must hold kmem.lock.
+static void
+buddyfree(uint64 n, int order)
+{
+  uint64 b;
+
+  for(; order < MAXORDER; order++){
+    b = n ^ (1L << order);
+    if(b >= NPAGES || kmem.state[b] != (FREE | order))
+      break;
+    pull(b, order);
+    if(b < n)
+      n = b;
+  }
+  push(n, order);
+}
+
+// Take the biggest aligned block off the front of the
+// not-yet-carved range.  Sets *np to its first page and
+// returns its order, or returns -1 if the range is empty.
+// Caller must hold kmem.lock.
+static int
+carve(uint64 *np)
+{
+  uint64 n;
+  int order;
+
+  n = kmem.lazy;
+  if(n >= kmem.lazyend)
+    return -1;
+  for(order = MAXORDER; order > 0; order--)
+    if((n & ((1L << order) - 1)) == 0 && n + (1L << order) <= kmem.lazyend)
+      break;
+  kmem.lazy += 1L << order;
+  *np = n;
+  return order;
+}
+
+// Take a block of 2^order pages, splitting a bigger
+// one if need be.  Returns 0 if there is none.
+// Caller must hold kmem.lock.
+static void*
+buddyalloc(int order)
+{
+  struct run *r;
+  uint64 n;
+  int k;
+
+  for(;;){
+    for(k = order; k <= MAXORDER; k++)
+      if(kmem.free[k].next != &kmem.free[k])
+        break;
+    if(k <= MAXORDER)
+      break;
+    if((k = carve(&n)) < 0)
+      return 0;
+    JUNK(PAGE(n), 1, PGSIZE << k);
+    buddyfree(n, k);
+  }
+  r = kmem.free[k].next;
+  n = PAGENO(r);
+  pull(n, k);
+  // give back the upper halves.
+  while(k > order){
+    k--;
+    push(n + (1L << k), k);
+  }
+  return (void*)r;
+}
+
+// Hand every CPU's single pages, and the zeroed pool,
+// back to the buddy lists, when they run out.
+static void
+reclaim(void)
+{
+  struct run *r;
+  int i;
+
+  acquire(&zpool.lock);
+  acquire(&kmem.lock);
+  while((r = zpool.list) != 0){
+    zpool.list = r->next;
+    buddyfree(PAGENO(r), 0);
+  }
+  zpool.n = 0;
+  release(&kmem.lock);
+  release(&zpool.lock);
+
+  for(i = 0; i < NCPU; i++){
+    acquire(&pcp[i].lock);
+    acquire(&kmem.lock);
+    while((r = pcp[i].list) != 0){
+      pcp[i].list = r->next;
+      buddyfree(PAGENO(r), 0);
+    }
+    pcp[i].n = 0;
+    release(&kmem.lock);
+    release(&pcp[i].lock);
+  }
+}
+
+// Make [pa_start, pa_end) the range that buddyalloc()
+// and kinithart() carve free blocks from.
 void
 freerange(void *pa_start, void *pa_end)
 {
-  char *p;
-  p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  acquire(&kmem.lock);
+  if(kmem.lazy < kmem.lazyend)
+    panic("freerange");
+  kmem.lazy = PAGENO(PGROUNDUP((uint64)pa_start));
+  kmem.lazyend = PAGENO(PGROUNDDOWN((uint64)pa_end));
+  release(&kmem.lock);
+}
+
+// Called by each hart but the first while hart 0 goes
+// on booting (paging is still off): put the rest of
+// free memory on the lists, a block at a time, so that
+// allocations need not do it later.
+void
+kinithart(void)
+{
+  uint64 n;
+  int order;
+
+  for(;;){
+    acquire(&kmem.lock);
+    order = carve(&n);
+    release(&kmem.lock);
+    if(order < 0)
+      break;
+    // outside the lock, so harts fill in parallel.
+    JUNK(PAGE(n), 1, PGSIZE << order);
+    acquire(&kmem.lock);
+    buddyfree(n, order);
+    release(&kmem.lock);
+  }
+}
+
+// Free the block of 2^order pages at pa, which
+// normally should have been returned by a call to
+// kalloc_order(order).
+void
+kfree_order(void *pa, int order)
+{
+  if(order < 0 || order > MAXORDER || ((uint64)pa % (PGSIZE << order)) != 0 ||
+     (char*)pa < end || (uint64)pa + (PGSIZE << order) > PHYSTOP)
+    panic("kfree_order");
+
+  // Fill with junk to catch dangling refs.
+  JUNK(pa, 1, PGSIZE << order);
+
+  acquire(&kmem.lock);
+  buddyfree(PAGENO(pa), order);
+  release(&kmem.lock);
+}
+
+// Allocate 2^order physically contiguous pages, aligned
+// to their size.  Returns a pointer that the kernel can use.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_order(int order)
+{
+  void *pa;
+
+  if(order < 0 || order > MAXORDER)
+    return 0;
+  acquire(&kmem.lock);
+  pa = buddyalloc(order);
+  release(&kmem.lock);
+  if(pa == 0){
+    reclaim();
+    acquire(&kmem.lock);
+    pa = buddyalloc(order);
+    release(&kmem.lock);
+  }
+
+  if(pa)
+    JUNK(pa, 5, PGSIZE << order); // fill with junk
+  return pa;
 }
 
 // Free the page of physical memory pointed at by pa,
@@ -47,19 +308,33 @@ void
 kfree(void *pa)
 {
   struct run *r;
+  int c, i;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
   // Fill with junk to catch dangling refs.
-  memset(pa, 1, PGSIZE);
+  JUNK(pa, 1, PGSIZE);
 
+  push_off();
+  c = cpuid();
+  acquire(&pcp[c].lock);
+  if(pcp[c].n >= PCPMAX){
+    acquire(&kmem.lock);
+    for(i = 0; i < PCPBATCH; i++){
+      r = pcp[c].list;
+      pcp[c].list = r->next;
+      buddyfree(PAGENO(r), 0);
+    }
+    release(&kmem.lock);
+    pcp[c].n -= PCPBATCH;
+  }
   r = (struct run*)pa;
-
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  r->next = pcp[c].list;
+  pcp[c].list = r;
+  pcp[c].n++;
+  release(&pcp[c].lock);
+  pop_off();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -69,14 +344,129 @@ void *
 kalloc(void)
 {
   struct run *r;
+  int c;
+
+  push_off();
+  c = cpuid();
+  acquire(&pcp[c].lock);
+  if(pcp[c].n == 0){
+    acquire(&kmem.lock);
+    while(pcp[c].n < PCPBATCH && (r = buddyalloc(0)) != 0){
+      r->next = pcp[c].list;
+      pcp[c].list = r;
+      pcp[c].n++;
+    }
+    release(&kmem.lock);
+  }
+  r = pcp[c].list;
+  if(r){
+    pcp[c].list = r->next;
+    pcp[c].n--;
+  }
+  release(&pcp[c].lock);
+  pop_off();
+
+  if(r == 0)
+    return kalloc_order(0);   // take back other CPUs' pages
+
+  JUNK((char*)r, 5, PGSIZE); // fill with junk
+  return (void*)r;
+}
+
+// Allocate one page of physical memory filled with
+// zeros, from the pool of pages zeroed by idle harts
+// if it has any.  Returns 0 if out of memory.
+void *
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  acquire(&zpool.lock);
+  r = zpool.list;
+  if(r){
+    zpool.list = r->next;
+    zpool.n--;
+  }
+  release(&zpool.lock);
+
+  if(r){
+    r->next = 0;
+    return (void*)r;
+  }
+  if((r = kalloc()) != 0)
+    memset((char*)r, 0, PGSIZE);
+  return (void*)r;
+}
 
+// Called by scheduler() when it has nothing to run:
+// zero one free page and add it to the pool.  Returns 0
+// if the pool is full or no page is free (without taking
+// other CPUs' pages back), so the caller can go idle.
+int
+kzero(void)
+{
+  struct run *r;
+
+  if(zpool.n >= ZPOOLMAX)
+    return 0;
   acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  r = buddyalloc(0);
   release(&kmem.lock);
+  if(r == 0)
+    return 0;
 
-  if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
-  return (void*)r;
+  memset((char*)r, 0, PGSIZE);
+  acquire(&zpool.lock);
+  r->next = zpool.list;
+  zpool.list = r;
+  zpool.n++;
+  release(&zpool.lock);
+  return 1;
+}
+
+// Free pages, including ones not yet carved or held
+// by a CPU or the zeroed pool.  Only a snapshot.
+uint64
+kfreepages(void)
+{
+  uint64 n;
+  int i;
+
+  acquire(&kmem.lock);
+  n = kmem.lazyend - kmem.lazy;
+  for(i = 0; i <= MAXORDER; i++)
+    n += (uint64)kmem.nfree[i] << i;
+  release(&kmem.lock);
+  for(i = 0; i < NCPU; i++)
+    n += pcp[i].n;
+  return n + zpool.n;
+}
+
+// Print free memory by block size, and how much of it
+// is in blocks of at least a megapage (for ^P).
+void
+kmemdump(void)
+{
+  int i, cached, nfree[MAXORDER+1];
+  uint64 total, big, lazy;
+
+  cached = 0;
+  for(i = 0; i < NCPU; i++)
+    cached += pcp[i].n;
+  acquire(&kmem.lock);
+  for(i = 0; i <= MAXORDER; i++)
+    nfree[i] = kmem.nfree[i];
+  lazy = kmem.lazyend - kmem.lazy;
+  release(&kmem.lock);
+
+  total = big = 0;
+  printf("free blocks by order:");
+  for(i = 0; i <= MAXORDER; i++){
+    printf(" %d", nfree[i]);
+    total += (uint64)nfree[i] << i;
+    if(i >= 9)
+      big += (uint64)nfree[i] << i;
+  }
+  printf("\nfree pages %ld (+%d per-cpu, +%d zeroed, +%ld not yet carved), %ld%% in 2MB blocks\n",
+         total, cached, zpool.n, lazy, total ? big * 100 / total : 0);
 }
@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "proc.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -16,10 +17,16 @@
 // write an uncommitted system call's updates to disk.
 //
 // A system call should call begin_op()/end_op() to mark
-// its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// its start and end. begin_op() reserves log space for
+// MAXOPBLOCKS blocks; a call that may write more, such as
+// a large write(), uses begin_opn() to reserve its real
+// count, up to log_opmax(). Usually begin_op() just adds
+// the reservation and returns. But if the log might run
+// out, it sleeps until the last outstanding end_op() commits.
+//
+// The log's size comes from the superblock, so mkfs decides
+// it; the header block limits it to LOGMAX blocks, and it
+// must hold at least the MAXOPBLOCKS of one begin_op().
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -28,13 +35,52 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// Log appends are synchronous.  commit() writes the new
+// transaction's blocks and the header in one batch, so the
+// header may reach the disk before the blocks do.  It
+// therefore holds a checksum of the newest transaction's
+// blocks, and recovery ignores that transaction unless
+// they all match it.  The header is only cleared when the
+// log is checkpointed, not after every commit.
+//
+// Committed blocks are not written to their home locations
+// right away.  They stay pinned and dirty in the buffer cache,
+// and later transactions are appended after them in the log.
+// When the log fills up, and every FLUSHTICKS ticks in the
+// flusher thread, checkpoint() writes each dirty block home
+// once, in block order, and then empties the log.  A bitmap or
+// inode block that every transaction changes is thus logged
+// by each transaction but written home once per checkpoint.
+// If the same block is logged by several transactions,
+// recovery installs the copies in log order, so the last wins.
+//
+// When a transaction frees a block, log_revoke() clears the
+// header entries for the copies earlier transactions logged:
+// a 0 entry is a revoke record, which tells checkpoint() and
+// recovery not to write that copy home.  Copies logged after
+// the block is allocated again are still installed.  Until
+// the freeing transaction has committed, a revoked entry is
+// kept as minus the block number, so that recovery can undo
+// the revoke if that transaction turns out to be torn.
+//
+// Only the current transaction's blocks are pinned in the
+// buffer cache.  Once committed, a dirty block may be evicted,
+// and bget() then writes it home first, which is safe because
+// its data is already in the log.
+
+// Most blocks one transaction may write: they stay pinned in the
+// buffer cache until it commits.
+#define MAXTRANS (NBUF/2)
+
+#define LOGHASH  256    // buckets in the index of log entries
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
-  int block[LOGSIZE];
+  int prev;        // block[prev..n) are the newest transaction
+  uint sum;        // logsum() of the newest transaction
+  int block[];     // log.size-1 entries
 };
 
 struct log {
@@ -42,44 +88,114 @@ struct log {
   int start;
   int size;
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // blocks reserved by the executing calls
+  int committing;  // in commit() or checkpoint(), please wait.
+  int flushing;    // flusher() wants a checkpoint, please wait.
   int dev;
-  struct logheader lh;
+  int committed;   // lh->block[0..committed) are committed, not yet home
+  int nrevoke;     // entries revoked by the current transaction
+  struct logheader *lh;  // a page, like sorted and hnext
+  int *sorted;           // checkpoint()'s block numbers
+  int *hnext;            // next older entry in the same bucket
+  int hhead[LOGHASH];    // newest entry hashing to each bucket, or -1
+  struct buf *wbuf[MAXTRANS+1];  // commit()'s batch of writes
+  uint wto[MAXTRANS+1];
 };
 struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void checkpoint(void);
+static void hashclear(void);
+static void flusher(void*);
 
 void
 initlog(int dev, struct superblock *sb)
 {
-  if (sizeof(struct logheader) >= BSIZE)
-    panic("initlog: too big logheader");
+  if (sb->nlog - 1 < MAXOPBLOCKS || sb->nlog - 1 > LOGMAX)
+    panic("initlog: bad log size");
 
   initlock(&log.lock, "log");
   log.start = sb->logstart;
   log.size = sb->nlog;
   log.dev = dev;
+  log.lh = kalloc();
+  log.sorted = kalloc();
+  log.hnext = kalloc();
+  if(log.lh == 0 || log.sorted == 0 || log.hnext == 0)
+    panic("initlog: kalloc");
+  hashclear();
   recover_from_log();
+  if(kthread(flusher, 0, "flusher") == 0)
+    panic("initlog: flusher");
 }
 
-// Copy committed blocks from log to their home location
+// Empty the index of log entries.
 static void
-install_trans(int recovering)
+hashclear(void)
+{
+  int h;
+
+  for(h = 0; h < LOGHASH; h++)
+    log.hhead[h] = -1;
+}
+
+// Add entry i of the log header to the index.
+static void
+hashadd(int i)
+{
+  int h = log.lh->block[i] % LOGHASH;
+
+  log.hnext[i] = log.hhead[h];
+  log.hhead[h] = i;
+}
+
+// The newest entry for block bno in the index
+// older than entry i (or than all, if i is -1), or -1.
+static int
+hashfind(int bno, int i)
+{
+  i = (i < 0 ? log.hhead[bno % LOGHASH] : log.hnext[i]);
+  while(i >= 0 && log.lh->block[i] != bno)
+    i = log.hnext[i];
+  return i;
+}
+
+// Copy committed blocks from log to their home location.
+// Used only by recovery.  Only the newest copy of each
+// block is installed, and revoked (0) entries not at all.
+static void
+install_trans(void)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
+  for (tail = log.lh->n - 1; tail >= 0; tail--) {
+    if (log.lh->block[tail] == 0 || hashfind(log.lh->block[tail], -1) >= 0)
+      continue;
+    hashadd(tail);
     struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
+    struct buf *dbuf = bread(log.dev, log.lh->block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
     bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
     brelse(lbuf);
     brelse(dbuf);
   }
+  hashclear();
+}
+
+// Add block number bno, holding data, to checksum sum.
+// The checksum of a transaction starts at LOGSUM0.
+#define LOGSUM0 2166136261
+static uint
+logsum(uint sum, int bno, uchar *data)
+{
+  uint *p = (uint *) data;
+  int i;
+
+  sum = (sum ^ bno) * 16777619;
+  for (i = 0; i < BSIZE / sizeof(uint); i++)
+    sum = (sum ^ p[i]) * 16777619;
+  return sum;
 }
 
 // Read the log header from disk into the in-memory log header
@@ -89,52 +205,124 @@ read_head(void)
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *lh = (struct logheader *) (buf->data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  if (lh->n < 0 || lh->n > log.size - 1 || lh->prev < 0 || lh->prev > lh->n)
+    panic("read_head: bad log header");
+  log.lh->n = lh->n;
+  log.lh->prev = lh->prev;
+  log.lh->sum = lh->sum;
+  for (i = 0; i < log.lh->n; i++) {
+    log.lh->block[i] = lh->block[i];
   }
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Copy the in-memory log header into the header block buf,
+// with sum as the checksum of the newest transaction.
 static void
-write_head(void)
+fill_head(struct buf *buf, uint sum)
 {
-  struct buf *buf = bread(log.dev, log.start);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = log.lh->n;
+  hb->prev = log.committed;
+  hb->sum = sum;
+  for (i = 0; i < log.lh->n; i++) {
+    hb->block[i] = log.lh->block[i];
   }
+}
+
+// Write an empty in-memory log header to disk.
+static void
+write_head(void)
+{
+  struct buf *buf = bread(log.dev, log.start);
+  fill_head(buf, LOGSUM0);
   bwrite(buf);
   brelse(buf);
 }
 
+// Did all of the newest transaction's blocks reach the log?
+static int
+newest_ok(void)
+{
+  struct buf *b;
+  uint sum;
+  int i;
+
+  sum = LOGSUM0;
+  for (i = log.lh->prev; i < log.lh->n; i++) {
+    b = bread(log.dev, log.start+i+1);
+    sum = logsum(sum, log.lh->block[i], b->data);
+    brelse(b);
+  }
+  return sum == log.lh->sum;
+}
+
 static void
 recover_from_log(void)
 {
+  int i, torn;
+
   read_head();
-  install_trans(1); // if committed, copy from log to disk
-  log.lh.n = 0;
+  torn = !newest_ok();
+  if (torn)
+    log.lh->n = log.lh->prev;   // it never committed
+  for (i = 0; i < log.lh->n; i++) {
+    if (log.lh->block[i] < 0)   // revoked by the newest transaction
+      log.lh->block[i] = (torn ? -log.lh->block[i] : 0);
+  }
+  install_trans(); // if committed, copy from log to disk
+  log.lh->n = 0;
   write_head(); // clear the log
 }
 
+// The most blocks one FS system call may reserve.
+int
+log_opmax(void)
+{
+  if(log.size - 1 < MAXTRANS)
+    return log.size - 1;
+  return MAXTRANS;
+}
+
 // called at the start of each FS system call.
 void
 begin_op(void)
 {
+  begin_opn(MAXOPBLOCKS);
+}
+
+// called at the start of an FS system call that
+// may write up to n blocks.
+void
+begin_opn(int n)
+{
+  if(n > log_opmax())
+    panic("begin_opn: too many blocks");
+
   acquire(&log.lock);
   while(1){
-    if(log.committing){
-      sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    if(log.committing || log.flushing){
       sleep(&log, &log.lock);
+    } else if(log.lh->n + log.reserved + n > log.size - 1 ||
+              log.lh->n - log.committed + log.reserved + n > MAXTRANS){
+      if(log.outstanding == 0){
+        // the log is full of committed transactions;
+        // write them home to make room.
+        log.committing = 1;
+        release(&log.lock);
+        checkpoint();
+        acquire(&log.lock);
+        log.committing = 0;
+        wakeup(&log);
+      } else {
+        // this op might exhaust log space; wait for commit.
+        sleep(&log, &log.lock);
+      }
     } else {
       log.outstanding += 1;
+      log.reserved += n;
+      myproc()->logres = n;
       release(&log.lock);
       break;
     }
@@ -150,6 +338,7 @@ end_op(void)
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= myproc()->logres;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
@@ -157,8 +346,7 @@ end_op(void)
     log.committing = 1;
   } else {
     // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
+    // and this call's reservation has been released.
     wakeup(&log);
   }
   release(&log.lock);
@@ -174,37 +362,128 @@ end_op(void)
   }
 }
 
-// Copy modified blocks from cache to log.
+// Write the current transaction's blocks to the log, straight
+// from their cache buffers, together with the header that
+// commits them.
 static void
-write_log(void)
+commit()
 {
-  int tail;
+  int i, k;
+  uint sum;
+  struct buf *b;
+
+  if (log.lh->n == log.committed && log.nrevoke == 0)
+    return;
+
+  sum = LOGSUM0;
+  k = 0;
+  for (i = log.committed; i < log.lh->n; i++) {
+    b = bread(log.dev, log.lh->block[i]);  // cached: it is pinned
+    sum = logsum(sum, b->blockno, b->data);
+    log.wbuf[k] = b;
+    log.wto[k++] = log.start+i+1;
+  }
+  b = bread(log.dev, log.start);
+  fill_head(b, sum);
+  log.wbuf[k] = b;
+  log.wto[k++] = log.start;
+  bwritev(log.wbuf, log.wto, k);   // the real commit
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  // checkpoint() will install the blocks; until then they
+  // are dirty, but need not stay in the cache.
+  for (i = 0; i < k - 1; i++) {
+    bunpin(log.wbuf[i]);
+    brelse(log.wbuf[i]);
+  }
+  brelse(b);
+
+  // the revokes this transaction made are durable now.
+  for (i = 0; log.nrevoke > 0 && i < log.committed; i++) {
+    if (log.lh->block[i] < 0) {
+      log.lh->block[i] = 0;
+      log.nrevoke--;
+    }
   }
+  log.committed = log.lh->n;
 }
 
+// Write the committed blocks to their home locations, each
+// once and in block order, and then erase them from the log.
+// Caller has set log.committing with no FS system calls
+// outstanding, so the cached blocks hold committed data only.
 static void
-commit()
+checkpoint(void)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  int *blocks = log.sorted;
+  int i, j, n, bno;
+
+  if(log.lh->n == 0)
+    return;
+  // the newest entry of each block, not revoked, sorted.
+  n = 0;
+  for(i = 0; i < log.lh->n; i++){
+    bno = log.lh->block[i];
+    if(bno == 0 || hashfind(bno, -1) != i)
+      continue;  // revoked, or logged again later
+    for(j = n; j > 0 && blocks[j-1] > bno; j--)
+      blocks[j] = blocks[j-1];
+    blocks[j] = bno;
+    n++;
+  }
+
+  // bflush() writes a block only while it is dirty, so
+  // not at all if eviction already wrote it.
+  for(i = 0; i < n; i++)
+    bflush(log.dev, blocks[i]);
+
+  log.lh->n = 0;
+  log.committed = 0;
+  hashclear();
+  write_head();    // Erase the checkpointed transactions
+}
+
+// Checkpoint every FLUSHTICKS ticks, so that committed
+// blocks reach their home locations even if the log never
+// fills up.
+static void
+flusher(void *arg)
+{
+  uint ticks0;
+
+  for(;;){
+    acquire(&tickslock);
+    ticks0 = ticks;
+    while(ticks - ticks0 < FLUSHTICKS)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+
+    acquire(&log.lock);
+    if(log.lh->n == 0){
+      release(&log.lock);
+      continue;
+    }
+    // hold off new FS system calls until the current ones
+    // have ended and committed.
+    log.flushing = 1;
+    while(log.committing || log.outstanding > 0)
+      sleep(&log, &log.lock);
+    log.flushing = 0;
+    log.committing = 1;
+    release(&log.lock);
+
+    checkpoint();
+
+    acquire(&log.lock);
+    log.committing = 0;
+    wakeup(&log);
+    release(&log.lock);
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
-// Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// Record the block number, mark it dirty, and pin it in the cache
+// by increasing refcnt.  commit() will write it to the
+// log and unpin it, and checkpoint() will write it home.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -217,20 +496,61 @@ log_write(struct buf *b)
   int i;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
-    panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
-  for (i = 0; i < log.lh.n; i++) {
-    if (log.lh.block[i] == b->blockno)   // log absorption
-      break;
-  }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n) {  // Add new block to log?
+  b->dirty = 1;
+  i = hashfind(b->blockno, -1);
+  if (i < log.committed) {  // Add new block to this transaction?
+    if (log.lh->n >= log.size - 1 || log.lh->n - log.committed >= MAXTRANS)
+      panic("too big a transaction");
+    i = log.lh->n++;
+    log.lh->block[i] = b->blockno;
+    hashadd(i);
     bpin(b);
-    log.lh.n++;
+  }                         // else log absorption
+  release(&log.lock);
+}
+
+// Block bno has been freed by the current transaction.  Revoke
+// the copies that earlier transactions logged, and if this one
+// has not logged it, forget its cached contents, so that it is
+// not written home at all.  The caller holds the bitmap block,
+// so bno can't be allocated and logged again meanwhile.
+void
+log_revoke(uint bno)
+{
+  int i, revoked, mine;
+
+  revoked = mine = 0;
+  acquire(&log.lock);
+  if (log.outstanding < 1)
+    panic("log_revoke outside of trans");
+  for (i = hashfind(bno, -1); i >= 0; i = hashfind(bno, i)) {
+    if (i >= log.committed) {
+      mine = 1;
+    } else {
+      log.lh->block[i] = -bno;   // 0 once this transaction commits
+      log.nrevoke++;
+      revoked = 1;
+    }
   }
   release(&log.lock);
+
+  if (revoked && !mine)
+    bforget(log.dev, bno);
+}
+
+// For bforget() of locked buffer b: mark it clean, unless the
+// current transaction has logged it since log_revoke() looked
+// (the newest entry for a block is the one hashfind() sees
+// first).
+void
+log_forget(struct buf *b)
+{
+  acquire(&log.lock);
+  if (hashfind(b->blockno, -1) < log.committed)
+    b->dirty = 0;
+  release(&log.lock);
 }
 
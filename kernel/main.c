@@ -5,6 +5,7 @@
 #include "defs.h"
 
 volatile static int started = 0;
+volatile static int kready = 0;
 
 // start() jumps here in supervisor mode on all CPUs.
 void
@@ -17,8 +18,13 @@ main()
     printf("xv6 kernel is booting\n");
     printf("\n");
     kinit();         // physical page allocator
+    __sync_synchronize();
+    kready = 1;
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+#ifdef STRBENCH
+    strbench();      // time memset, memmove, memcmp
+#endif
     procinit();      // process table
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
@@ -26,12 +32,19 @@ main()
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode table
+    dcacheinit();    // directory name lookup cache
     fileinit();      // file table
+    pipeinit();      // pipe cache
+    pollinit();      // poll() wait queue
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
     started = 1;
   } else {
+    while(kready == 0)
+      ;
+    __sync_synchronize();
+    kinithart();      // help fill the free lists
     while(started == 0)
       ;
     __sync_synchronize();
@@ -1,15 +1,19 @@
 #define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
-#define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define MAXOPBLOCKS  10  // max # of blocks most FS ops write
+#ifndef LOGSIZE
+#define LOGSIZE      250   // data blocks in the on-disk log mkfs makes
+#endif
+#define NBUF         128   // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
+#define FLUSHTICKS   30    // ticks between checkpoints of the log
 #define MAXPATH      128   // maximum file path name
 #define USERSTACK    1     // user stack pages
+#define PIPEMAXPAGES 16    // max data pages per pipe (a power of two)
+#define MAXORDER     10    // largest kalloc_order() block is 2^MAXORDER pages
+#define NDCACHE      256   // entries in the directory name lookup cache
 
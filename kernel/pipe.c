@@ -7,18 +7,45 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
+#include "fcntl.h"
+#include "slab.h"
 
-#define PIPESIZE 512
-
+// A pipe's data lives in a ring of whole pages.  The ring starts
+// out one page long and pipewrite() doubles it, up to PIPEMAXPAGES,
+// when a writer finds it full.  nread and nwrite count bytes; byte
+// i of the stream is at ring offset i % pipesize(pi).  The ring size
+// is always a power of two, so the counters can wrap around.
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *pages[PIPEMAXPAGES];
+  uint npages;    // number of pages in the ring
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
 };
 
+#define pipesize(pi) ((pi)->npages * PGSIZE)
+
+static struct kcache pipecache;
+
+void
+pipeinit(void)
+{
+  kcacheinit(&pipecache, "pipe", sizeof(struct pipe));
+}
+
+static void
+pipefree(struct pipe *pi)
+{
+  int i;
+
+  for(i = 0; i < pi->npages; i++)
+    kfree(pi->pages[i]);
+  kcachefree(&pipecache, pi);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,8 +55,12 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = (struct pipe*)kcachealloc(&pipecache)) == 0)
     goto bad;
+  memset(pi, 0, sizeof(*pi));
+  if((pi->pages[0] = kalloc()) == 0)
+    goto bad;
+  pi->npages = 1;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
@@ -47,7 +78,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    pipefree(pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -66,17 +97,72 @@ pipeclose(struct pipe *pi, int writable)
     pi->readopen = 0;
     wakeup(&pi->nwrite);
   }
+  pollwakeup();
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    pipefree(pi);
   } else
     release(&pi->lock);
 }
 
+// Double the size of a full pipe's ring.
+// The ring is rotated so that the page holding the oldest
+// unread byte becomes pages[0], and the new pages go at the
+// end.  Bytes that had wrapped around into the front of that
+// first page are copied into the first new page, so the unread
+// data stays contiguous in ring order.  nread and nwrite are
+// rebased to match.  Returns 0 on success, -1 if the ring is at
+// its maximum size or no memory is available.
+// Caller must hold pi->lock.
+static int
+pipegrow(struct pipe *pi)
+{
+  char *rot[PIPEMAXPAGES];
+  uint n, off, first, poff, wrap, i, np;
+
+  np = pi->npages;
+  if(2*np > PIPEMAXPAGES)
+    return -1;
+  for(i = 0; i < np; i++){
+    if((pi->pages[np+i] = kalloc()) == 0){
+      while(i-- > 0)
+        kfree(pi->pages[np+i]);
+      return -1;
+    }
+  }
+
+  n = pi->nwrite - pi->nread;
+  off = pi->nread % pipesize(pi);
+  first = off / PGSIZE;
+  poff = off % PGSIZE;
+
+  for(i = 0; i < np; i++)
+    rot[i] = pi->pages[(first + i) % np];
+  memmove(pi->pages, rot, np * sizeof(rot[0]));
+
+  // unread bytes that live in front of nread's byte in pages[0].
+  wrap = 0;
+  if(n > pipesize(pi) - poff)
+    wrap = n - (pipesize(pi) - poff);
+  if(wrap > 0)
+    memmove(pi->pages[np], pi->pages[0], wrap);
+
+  pi->npages = 2*np;
+  pi->nread = poff;
+  pi->nwrite = poff + n;
+  return 0;
+}
+
+// Write n bytes from addr into the pipe.
+// If user_src==1, then addr is a user virtual address;
+// otherwise, addr is a kernel address.
+// If nonblock, return what has been written so far, or
+// -EAGAIN if nothing, instead of waiting for room.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, int user_src, uint64 addr, int n, int nonblock)
 {
   int i = 0;
+  uint idx, m;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
@@ -85,29 +171,50 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
+    if(pi->nwrite == pi->nread + pipesize(pi)){ //DOC: pipewrite-full
+      if(pipegrow(pi) == 0)
+        continue;
+      if(nonblock){
+        if(i == 0)
+          i = -EAGAIN;
+        break;
+      }
       wakeup(&pi->nread);
+      pollwakeup();
       sleep(&pi->nwrite, &pi->lock);
     } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+      // copy as much as fits in the free space up to the
+      // end of the page that nwrite points into.
+      idx = pi->nwrite % pipesize(pi);
+      m = pi->nread + pipesize(pi) - pi->nwrite;
+      if(m > PGSIZE - idx % PGSIZE)
+        m = PGSIZE - idx % PGSIZE;
+      if(m > n - i)
+        m = n - i;
+      if(either_copyin(pi->pages[idx / PGSIZE] + idx % PGSIZE, user_src,
+                       addr + i, m) == -1)
         break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      pi->nwrite += m;
+      i += m;
     }
   }
   wakeup(&pi->nread);
+  pollwakeup();
   release(&pi->lock);
 
   return i;
 }
 
+// Read up to n bytes from the pipe into addr.
+// If user_dst==1, then addr is a user virtual address;
+// otherwise, addr is a kernel address.
+// If nonblock, return -EAGAIN instead of waiting for data.
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, int user_dst, uint64 addr, int n, int nonblock)
 {
   int i;
+  uint idx, m;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
@@ -115,16 +222,65 @@ piperead(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
+    if(nonblock){
+      release(&pi->lock);
+      return -EAGAIN;
+    }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
+  for(i = 0; i < n; i += m){  //DOC: piperead-copy
     if(pi->nread == pi->nwrite)
       break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+    // copy the unread bytes up to the end of nread's page.
+    idx = pi->nread % pipesize(pi);
+    m = pi->nwrite - pi->nread;
+    if(m > PGSIZE - idx % PGSIZE)
+      m = PGSIZE - idx % PGSIZE;
+    if(m > n - i)
+      m = n - i;
+    if(either_copyout(user_dst, addr + i,
+                      pi->pages[idx / PGSIZE] + idx % PGSIZE, m) == -1)
       break;
+    pi->nread += m;
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  pollwakeup();
   release(&pi->lock);
   return i;
 }
+
+// Return the number of unread bytes in the pipe.
+int
+pipeavail(struct pipe *pi)
+{
+  int n;
+
+  acquire(&pi->lock);
+  n = pi->nwrite - pi->nread;
+  release(&pi->lock);
+  return n;
+}
+
+// Return the poll() events that are ready on the
+// read end (writable==0) or write end of the pipe.
+int
+pipepoll(struct pipe *pi, int writable)
+{
+  int r = 0;
+
+  acquire(&pi->lock);
+  if(writable){
+    if(pi->readopen == 0)
+      r = POLLERR;
+    else if(pi->nwrite != pi->nread + pipesize(pi) ||
+            2*pi->npages <= PIPEMAXPAGES)
+      r = POLLOUT;
+  } else {
+    if(pi->nread != pi->nwrite)
+      r |= POLLIN;
+    if(pi->writeopen == 0)
+      r |= POLLIN | POLLHUP;
+  }
+  release(&pi->lock);
+  return r;
+}
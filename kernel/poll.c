@@ -0,0 +1,141 @@
+//
+// poll(): wait for any of several file descriptors
+// to become ready.
+//
+// A process can only sleep() on one channel, so all polling
+// processes sleep on pollq.  Pipes and the console call
+// pollwakeup() whenever they might have become ready, and
+// the poller rescans its file descriptors.  pollq.seq counts
+// wakeups so that one that happens during a scan isn't lost.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "poll.h"
+
+struct {
+  struct spinlock lock;
+  uint seq;       // incremented by every pollwakeup()
+  int nwaiting;   // processes in poll()
+  int ntimed;     // processes in poll() with a timeout
+} pollq;
+
+void
+pollinit(void)
+{
+  initlock(&pollq.lock, "pollq");
+}
+
+// Wake up processes in poll(), if there are any.
+// Called after a file's readiness may have changed.
+void
+pollwakeup(void)
+{
+  // poll() raises nwaiting before it scans, and the scan
+  // takes the file's lock, so a poller that is missed here
+  // will see the change that the caller just made.
+  __sync_synchronize();
+  if(pollq.nwaiting == 0)
+    return;
+
+  acquire(&pollq.lock);
+  pollq.seq++;
+  wakeup(&pollq);
+  release(&pollq.lock);
+}
+
+// Called on every clock tick, so that poll()
+// timeouts expire.
+void
+polltick(void)
+{
+  if(pollq.ntimed == 0)
+    return;
+
+  acquire(&pollq.lock);
+  pollq.seq++;
+  wakeup(&pollq);
+  release(&pollq.lock);
+}
+
+// Fill in revents for each of fds, and return
+// how many have at least one event.
+static int
+pollscan(struct pollfd *fds, int nfds)
+{
+  struct proc *p = myproc();
+  struct file *f;
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < nfds; i++){
+    fds[i].revents = 0;
+    if(fds[i].fd < 0)
+      continue;
+    if(fds[i].fd >= NOFILE || (f = p->ofile[fds[i].fd]) == 0)
+      fds[i].revents = POLLNVAL;
+    else
+      fds[i].revents = filepoll(f, fds[i].events);
+    if(fds[i].revents)
+      n++;
+  }
+  return n;
+}
+
+// Wait until at least one of the nfds pollfds at user
+// address addr has an event, or for timeout clock ticks
+// if timeout is not negative.
+// Returns the number of ready fds, 0 on timeout, or -1.
+int
+poll(uint64 addr, int nfds, int timeout)
+{
+  struct pollfd fds[NOFILE];
+  struct proc *p = myproc();
+  uint ticks0, seq;
+  int n;
+
+  if(nfds < 0 || nfds > NOFILE)
+    return -1;
+  if(copyin(p->pagetable, (char*)fds, addr, nfds*sizeof(fds[0])) < 0)
+    return -1;
+
+  acquire(&tickslock);
+  ticks0 = ticks;
+  release(&tickslock);
+
+  acquire(&pollq.lock);
+  pollq.nwaiting++;
+  if(timeout > 0)
+    pollq.ntimed++;
+  for(;;){
+    seq = pollq.seq;
+    release(&pollq.lock);
+    n = pollscan(fds, nfds);
+    acquire(&pollq.lock);
+    if(n > 0 || timeout == 0)
+      break;
+    if(timeout > 0 && ticks - ticks0 >= timeout)
+      break;
+    if(killed(p)){
+      n = -1;
+      break;
+    }
+    if(pollq.seq == seq)
+      sleep(&pollq, &pollq.lock);
+  }
+  pollq.nwaiting--;
+  if(timeout > 0)
+    pollq.ntimed--;
+  release(&pollq.lock);
+
+  if(n >= 0 && copyout(p->pagetable, addr, (char*)fds, nfds*sizeof(fds[0])) < 0)
+    return -1;
+  return n;
+}
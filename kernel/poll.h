@@ -0,0 +1,14 @@
+// poll() events.
+// Both the kernel and user programs use this header file.
+
+#define POLLIN    0x001  // data to read, or end of file
+#define POLLOUT   0x004  // room to write
+#define POLLERR   0x008  // write end of a pipe with no reader
+#define POLLHUP   0x010  // read end of a pipe with no writer
+#define POLLNVAL  0x020  // fd is not open
+
+struct pollfd {
+  int fd;         // file descriptor, or negative to skip
+  short events;   // events of interest
+  short revents;  // events that occurred
+};
@@ -16,6 +16,7 @@ int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
+extern void kthreadret(void);
 static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
@@ -168,6 +169,9 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->kfn = 0;
+  p->karg = 0;
+  p->io = 0;
   p->state = UNUSED;
 }
 
@@ -262,15 +266,22 @@ growproc(int n)
   uint64 sz;
   struct proc *p = myproc();
 
+  // a ring worker may be copying to or from p's memory.
+  ioring_vmlock(p);
   sz = p->sz;
   if(n > 0){
     if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+      ioring_vmunlock(p);
       return -1;
     }
   } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    if((sz = uvmdealloc(p->pagetable, sz, sz + n)) != p->sz + n){
+      ioring_vmunlock(p);
+      return -1;
+    }
   }
   p->sz = sz;
+  ioring_vmunlock(p);
   return 0;
 }
 
@@ -325,6 +336,35 @@ fork(void)
   return pid;
 }
 
+// Start a kernel thread running fn(arg), with the current
+// directory of the calling process.  It never enters user
+// space, and exits when fn returns.  Its parent is init,
+// which reaps it.
+struct proc*
+kthread(void (*fn)(void*), void *arg, char *name)
+{
+  struct proc *np;
+
+  if((np = allocproc()) == 0)
+    return 0;
+  np->context.ra = (uint64)kthreadret;
+  np->kfn = fn;
+  np->karg = arg;
+  np->cwd = idup(myproc()->cwd);
+  safestrcpy(np->name, name, sizeof(np->name));
+  release(&np->lock);
+
+  acquire(&wait_lock);
+  np->parent = initproc;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+  release(&np->lock);
+
+  return np;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold wait_lock.
 void
@@ -351,6 +391,9 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  // Let the ring worker finish with p's files and memory.
+  ioring_free(p);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -472,8 +515,9 @@ scheduler(void)
       }
       release(&p->lock);
     }
-    if(found == 0) {
-      // nothing to run; stop running on this core until an interrupt.
+    if(found == 0 && kzero() == 0) {
+      // nothing to run, and no page to zero for kalloc_zeroed();
+      // stop running on this core until an interrupt.
       intr_on();
       asm volatile("wfi");
     }
@@ -542,6 +586,20 @@ forkret(void)
   usertrapret();
 }
 
+// A kernel thread's first scheduling by scheduler()
+// will swtch to kthreadret.
+void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kfn(p->karg);
+  exit(0);
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
@@ -104,4 +104,8 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  void (*kfn)(void*);          // Kernel thread body, if a kernel thread
+  void *karg;                  // Argument to kfn
+  struct ioctx *io;            // Submission/completion ring, if any
+  int logres;                  // Log blocks reserved by begin_op()
 };
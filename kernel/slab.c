@@ -0,0 +1,160 @@
+// Slab allocator, for kernel objects smaller than a page.
+//
+// A cache hands out objects of one size.  It carves them
+// out of whole pages from kalloc(), called slabs; each
+// slab begins with a struct slab and links its free objects
+// through their first word.  A slab whose objects are all
+// free goes back to kalloc(), except for the last one.
+//
+// Each CPU keeps a magazine of a few objects per cache, so
+// that most allocations and frees touch only that CPU's
+// magazine and not the cache's lock.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "slab.h"
+
+struct slab {
+  struct slab *next;    // in the cache's list of slabs with free objects
+  struct slab *prev;
+  void *free;           // first free object
+  uint nfree;
+};
+
+#define SLAB(obj) ((struct slab*)PGROUNDDOWN((uint64)(obj)))
+
+void
+kcacheinit(struct kcache *c, char *name, uint size)
+{
+  size = (size + 7) & ~7;
+  if(size < sizeof(void*) || size > PGSIZE - sizeof(struct slab))
+    panic("kcacheinit");
+  memset(c, 0, sizeof(*c));
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - sizeof(struct slab)) / size;
+}
+
+static void
+slabunlink(struct kcache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->slabs = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Get a new slab, with all of its objects free.
+// Caller must hold c->lock.
+static struct slab*
+slabgrow(struct kcache *c)
+{
+  struct slab *s;
+  char *p;
+  int i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->free = 0;
+  p = (char*)(s + 1);
+  for(i = 0; i < c->perslab; i++){
+    *(void**)p = s->free;
+    s->free = p;
+    p += c->size;
+  }
+  s->nfree = c->perslab;
+  s->prev = 0;
+  s->next = c->slabs;
+  if(c->slabs)
+    c->slabs->prev = s;
+  c->slabs = s;
+  c->nslabs++;
+  return s;
+}
+
+// Fill half of magazine m from the slabs.
+static void
+refill(struct kcache *c, struct magazine *m)
+{
+  struct slab *s;
+  void *p;
+
+  acquire(&c->lock);
+  while(m->n < MAGSIZE/2){
+    if((s = c->slabs) == 0 && (s = slabgrow(c)) == 0)
+      break;
+    p = s->free;
+    s->free = *(void**)p;
+    if(--s->nfree == 0)
+      slabunlink(c, s);
+    m->obj[m->n++] = p;
+  }
+  release(&c->lock);
+}
+
+// Return half of magazine m to the slabs.
+static void
+drain(struct kcache *c, struct magazine *m)
+{
+  struct slab *s;
+  void *p;
+
+  acquire(&c->lock);
+  while(m->n > MAGSIZE/2){
+    p = m->obj[--m->n];
+    s = SLAB(p);
+    *(void**)p = s->free;
+    s->free = p;
+    if(s->nfree++ == 0){
+      s->prev = 0;
+      s->next = c->slabs;
+      if(c->slabs)
+        c->slabs->prev = s;
+      c->slabs = s;
+    }
+    if(s->nfree == c->perslab && (s != c->slabs || s->next)){
+      slabunlink(c, s);
+      c->nslabs--;
+      kfree((void*)s);
+    }
+  }
+  release(&c->lock);
+}
+
+// Allocate an object from cache c.
+// Returns 0 if the memory cannot be allocated.
+void*
+kcachealloc(struct kcache *c)
+{
+  struct magazine *m;
+  void *p;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == 0)
+    refill(c, m);
+  p = (m->n > 0 ? m->obj[--m->n] : 0);
+  pop_off();
+  return p;
+}
+
+// Free an object that came from kcachealloc(c).
+void
+kcachefree(struct kcache *c, void *p)
+{
+  struct magazine *m;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE)
+    drain(c, m);
+  m->obj[m->n++] = p;
+  pop_off();
+}
@@ -0,0 +1,21 @@
+// Cache of equal-sized kernel objects smaller than a page.
+// Requires spinlock.h and param.h.
+
+#define MAGSIZE 8  // objects each CPU keeps on hand
+
+// objects recently freed on one CPU, for that
+// CPU's next allocations.
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct kcache {
+  struct spinlock lock;
+  char *name;
+  uint size;            // of an object
+  uint perslab;         // objects in a slab
+  struct slab *slabs;   // slabs with free objects
+  int nslabs;           // pages held by the cache
+  struct magazine mag[NCPU];
+};
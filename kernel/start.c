@@ -40,6 +40,13 @@ start()
   // ask for clock interrupts.
   timerinit();
 
+#ifdef RVV
+  // memset() and memmove() may use the vector unit; they
+  // turn it on only while they do (see string.c).
+  if(r_misa() & MISA_V)
+    rvv = 1;
+#endif
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
@@ -58,8 +65,8 @@ timerinit()
   // enable the sstc extension (i.e. stimecmp).
   w_menvcfg(r_menvcfg() | (1L << 63)); 
   
-  // allow supervisor to use stimecmp and time.
-  w_mcounteren(r_mcounteren() | 2);
+  // allow supervisor to use stimecmp, time and cycle.
+  w_mcounteren(r_mcounteren() | 2 | 1);
   
   // ask for the very first timer interrupt.
   w_stimecmp(r_time() + 1000000);
@@ -0,0 +1,121 @@
+//
+// Boot-time benchmark of memset(), memmove() and memcmp(),
+// in kernels built with make STRBENCH=1.  Prints bytes per
+// clock cycle for a few sizes, next to the plain byte loops
+// string.c used to have, and with vectors off and on when
+// the harts have the V extension (make RVV=1).
+//
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define BENCHORDER  2                       // two 16 KB buffers
+#define BENCHBYTES  (256*1024)              // bytes per measurement
+
+enum { SET, MOVE, CMP };
+
+static char *opname[] = { "memset", "memmove", "memcmp" };
+static uint sizes[] = { 64, 1024, PGSIZE, PGSIZE << BENCHORDER };
+static volatile int sink;   // keeps the compare loops honest
+
+static void
+bytememset(char *d, int c, uint n)
+{
+  while(n-- > 0)
+    *d++ = c;
+}
+
+static void
+bytememmove(char *d, const char *s, uint n)
+{
+  while(n-- > 0)
+    *d++ = *s++;
+}
+
+static int
+bytememcmp(const uchar *s1, const uchar *s2, uint n)
+{
+  for(; n > 0; n--, s1++, s2++)
+    if(*s1 != *s2)
+      return *s1 - *s2;
+  return 0;
+}
+
+// cycles to do op on BENCHBYTES bytes, n at a time,
+// with the byte loops if bytes!=0.
+static uint64
+run(int op, int bytes, char *a, char *b, uint n)
+{
+  uint64 t0, i;
+
+  t0 = r_cycle();
+  for(i = 0; i < BENCHBYTES; i += n){
+    switch(op){
+    case SET:
+      if(bytes)
+        bytememset(a, i, n);
+      else
+        memset(a, i, n);
+      break;
+    case MOVE:
+      if(bytes)
+        bytememmove(a, b, n);
+      else
+        memmove(a, b, n);
+      break;
+    case CMP:
+      if(bytes)
+        sink += bytememcmp((uchar*)a, (uchar*)b, n);
+      else
+        sink += memcmp(a, b, n);
+      break;
+    }
+  }
+  return r_cycle() - t0;
+}
+
+// print BENCHBYTES per t cycles, with two decimals.
+static void
+report(char *what, uint64 t)
+{
+  uint64 rate;
+
+  if(t == 0)
+    t = 1;
+  rate = (uint64)BENCHBYTES * 100 / t;
+  printf(" %s %ld.%ld%ld", what, rate / 100, (rate / 10) % 10, rate % 10);
+}
+
+void
+strbench(void)
+{
+  char *a, *b;
+  int op, i, vec;
+
+  a = kalloc_order(BENCHORDER);
+  b = kalloc_order(BENCHORDER);
+  if(a == 0 || b == 0)
+    panic("strbench");
+  memset(a, 0, PGSIZE << BENCHORDER);
+  memset(b, 0, PGSIZE << BENCHORDER);
+
+  vec = rvv;
+  printf("string benchmark, bytes/cycle:\n");
+  for(op = SET; op <= CMP; op++){
+    for(i = 0; i < NELEM(sizes); i++){
+      printf("%s %d:", opname[op], sizes[i]);
+      report("bytes", run(op, 1, a, b, sizes[i]));
+      rvv = 0;
+      report("words", run(op, 0, a, b, sizes[i]));
+      rvv = vec;
+      if(vec && op != CMP)
+        report("vector", run(op, 0, a, b, sizes[i]));
+      printf("\n");
+    }
+  }
+
+  kfree_order(a, BENCHORDER);
+  kfree_order(b, BENCHORDER);
+}
@@ -1,13 +1,104 @@
 #include "types.h"
+#include "riscv.h"
+#include "defs.h"
+
+// memset, memmove and memcmp work a 64-bit word at a time
+// (four per loop) once the pointers are word-aligned, and
+// a byte at a time otherwise.  RVV kernels use vector
+// instructions for long runs instead, if start() found
+// that the harts have them.
+
+#define WSIZE       sizeof(uint64)
+#define ALIGNED(p)  (((uint64)(p) & (WSIZE - 1)) == 0)
+#define VMIN        256   // shorter runs aren't worth push_off()
+
+int rvv;  // set by start() if the harts have the V extension
+
+#ifdef RVV
+// The vector registers are not saved by swtch() or on traps,
+// so callers must have interrupts off, and the vector unit is
+// on only inside vmemset() and vmemcpy(): user code, which
+// would see what the kernel left there, always has it off.
+// Each round moves vl bytes, as many as the hart does at
+// once (LMUL=8).
+static void
+vmemset(char *d, int c, uint64 n)
+{
+  uint64 vl;
+
+  w_sstatus(r_sstatus() | SSTATUS_VS_INIT);
+  while(n > 0){
+    asm volatile(".option push\n"
+                 ".option arch, +v\n"
+                 "vsetvli %0, %2, e8, m8, ta, ma\n"
+                 "vmv.v.x v0, %3\n"
+                 "vse8.v v0, (%1)\n"
+                 ".option pop"
+                 : "=&r" (vl) : "r" (d), "r" (n), "r" (c) : "memory");
+    d += vl;
+    n -= vl;
+  }
+  w_sstatus(r_sstatus() & ~SSTATUS_VS);
+}
+
+// a forward copy, so also right for overlaps with d < s.
+static void
+vmemcpy(char *d, const char *s, uint64 n)
+{
+  uint64 vl;
+
+  w_sstatus(r_sstatus() | SSTATUS_VS_INIT);
+  while(n > 0){
+    asm volatile(".option push\n"
+                 ".option arch, +v\n"
+                 "vsetvli %0, %3, e8, m8, ta, ma\n"
+                 "vle8.v v0, (%2)\n"
+                 "vse8.v v0, (%1)\n"
+                 ".option pop"
+                 : "=&r" (vl) : "r" (d), "r" (s), "r" (n) : "memory");
+    d += vl;
+    s += vl;
+    n -= vl;
+  }
+  w_sstatus(r_sstatus() & ~SSTATUS_VS);
+}
+#endif
 
 void*
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uchar *d = dst;
+  uint64 w, *wd;
+
+#ifdef RVV
+  if(rvv && n >= VMIN){
+    push_off();
+    vmemset(dst, c, n);
+    pop_off();
+    return dst;
+  }
+#endif
+
+  while(n > 0 && !ALIGNED(d)){
+    *d++ = c;
+    n--;
+  }
+  w = (uchar)c;
+  w |= w << 8;
+  w |= w << 16;
+  w |= w << 32;
+  wd = (uint64*)d;
+  for(; n >= 4*WSIZE; n -= 4*WSIZE, wd += 4){
+    wd[0] = w;
+    wd[1] = w;
+    wd[2] = w;
+    wd[3] = w;
   }
+  for(; n >= WSIZE; n -= WSIZE)
+    *wd++ = w;
+  d = (uchar*)wd;
+  while(n-- > 0)
+    *d++ = c;
   return dst;
 }
 
@@ -18,6 +109,15 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+  if(ALIGNED((uint64)s1 ^ (uint64)s2)){
+    for(; n > 0 && !ALIGNED(s1); n--, s1++, s2++)
+      if(*s1 != *s2)
+        return *s1 - *s2;
+    // skip equal words; the bytes below find the difference.
+    for(; n >= WSIZE; n -= WSIZE, s1 += WSIZE, s2 += WSIZE)
+      if(*(uint64*)s1 != *(uint64*)s2)
+        break;
+  }
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -32,6 +132,8 @@ memmove(void *dst, const void *src, uint n)
 {
   const char *s;
   char *d;
+  const uint64 *ws;
+  uint64 *wd;
 
   if(n == 0)
     return dst;
@@ -41,11 +143,54 @@ memmove(void *dst, const void *src, uint n)
   if(s < d && s + n > d){
     s += n;
     d += n;
+    if(ALIGNED((uint64)s ^ (uint64)d)){
+      for(; n > 0 && !ALIGNED(d); n--)
+        *--d = *--s;
+      ws = (const uint64*)s;
+      wd = (uint64*)d;
+      for(; n >= 4*WSIZE; n -= 4*WSIZE){
+        ws -= 4;
+        wd -= 4;
+        wd[3] = ws[3];
+        wd[2] = ws[2];
+        wd[1] = ws[1];
+        wd[0] = ws[0];
+      }
+      for(; n >= WSIZE; n -= WSIZE)
+        *--wd = *--ws;
+      s = (const char*)ws;
+      d = (char*)wd;
+    }
     while(n-- > 0)
       *--d = *--s;
-  } else
+  } else {
+#ifdef RVV
+    if(rvv && n >= VMIN){
+      push_off();
+      vmemcpy(d, s, n);
+      pop_off();
+      return dst;
+    }
+#endif
+    if(ALIGNED((uint64)s ^ (uint64)d)){
+      for(; n > 0 && !ALIGNED(d); n--)
+        *d++ = *s++;
+      ws = (const uint64*)s;
+      wd = (uint64*)d;
+      for(; n >= 4*WSIZE; n -= 4*WSIZE, ws += 4, wd += 4){
+        wd[0] = ws[0];
+        wd[1] = ws[1];
+        wd[2] = ws[2];
+        wd[3] = ws[3];
+      }
+      for(; n >= WSIZE; n -= WSIZE)
+        *wd++ = *ws++;
+      s = (const char*)ws;
+      d = (char*)wd;
+    }
     while(n-- > 0)
       *d++ = *s++;
+  }
 
   return dst;
 }
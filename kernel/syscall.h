@@ -20,3 +20,13 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_splice 22
+#define SYS_sendfile 23
+#define SYS_poll   24
+#define SYS_fcntl  25
+#define SYS_ioring_setup 26
+#define SYS_ioring_enter 27
+#define SYS_readv  28
+#define SYS_writev 29
+#define SYS_pread  30
+#define SYS_pwrite 31
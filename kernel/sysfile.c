@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -76,7 +77,7 @@ sys_read(void)
   argint(2, &n);
   if(argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  return fileread(f, 1, p, n);
 }
 
 uint64
@@ -91,22 +92,121 @@ sys_write(void)
   if(argfd(0, 0, &f) < 0)
     return -1;
 
-  return filewrite(f, p, n);
+  return filewrite(f, 1, p, n);
+}
+
+// Fetch the array of iovcnt iovecs at user address addr.
+// Each buffer and the total must fit in an int.
+static int
+argiov(uint64 addr, int iovcnt, struct iovec *iov)
+{
+  uint64 tot = 0;
+  int i;
+
+  if(iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, addr, iovcnt*sizeof(struct iovec)) < 0)
+    return -1;
+  for(i = 0; i < iovcnt; i++){
+    if(iov[i].iov_len > 0x7fffffff)
+      return -1;
+    tot += iov[i].iov_len;
+  }
+  if(tot > 0x7fffffff)
+    return -1;
+  return 0;
 }
 
 uint64
-sys_close(void)
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int iovcnt;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &iovcnt);
+  if(argfd(0, 0, &f) < 0 || argiov(p, iovcnt, iov) < 0)
+    return -1;
+  return filereadv(f, 1, iov, iovcnt, -1);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int iovcnt;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &iovcnt);
+  if(argfd(0, 0, &f) < 0 || argiov(p, iovcnt, iov) < 0)
+    return -1;
+  return filewritev(f, 1, iov, iovcnt, -1);
+}
+
+// read at an offset, leaving f->off alone.
+uint64
+sys_pread(void)
 {
-  int fd;
   struct file *f;
+  struct iovec iov;
+  int n, off;
+  uint64 p;
 
-  if(argfd(0, &fd, &f) < 0)
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if(argfd(0, 0, &f) < 0 || n < 0 || off < 0)
+    return -1;
+  iov.iov_base = (void*)p;
+  iov.iov_len = n;
+  return filereadv(f, 1, &iov, 1, off);
+}
+
+// write at an offset, leaving f->off alone.
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if(argfd(0, 0, &f) < 0 || n < 0 || off < 0)
+    return -1;
+  iov.iov_base = (void*)p;
+  iov.iov_len = n;
+  return filewritev(f, 1, &iov, 1, off);
+}
+
+// Close file descriptor fd of the current process.
+int
+fdclose(int fd)
+{
+  struct file *f;
+
+  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
     return -1;
   myproc()->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
 
+uint64
+sys_close(void)
+{
+  int fd;
+
+  argint(0, &fd);
+  return fdclose(fd);
+}
+
 uint64
 sys_fstat(void)
 {
@@ -222,7 +322,9 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcacheenter(dp->dev, dp->inum, name, 0, 0);
   if(ip->type == T_DIR){
+    dcachepurge(ip->dev, ip->inum);
     dp->nlink--;
     iupdate(dp);
   }
@@ -262,7 +364,7 @@ create(char *path, short type, short major, short minor)
     return 0;
   }
 
-  if((ip = ialloc(dp->dev, type)) == 0){
+  if((ip = ialloc(dp->dev, type, dp->inum)) == 0){
     iunlockput(dp);
     return 0;
   }
@@ -274,6 +376,8 @@ create(char *path, short type, short major, short minor)
   iupdate(ip);
 
   if(type == T_DIR){  // Create . and .. entries.
+    // ip->inum may have been a directory before.
+    dcachepurge(ip->dev, ip->inum);
     // No ip->nlink++ for ".": avoid cyclic ref count.
     if(dirlink(ip, ".", ip->inum) < 0 || dirlink(ip, "..", dp->inum) < 0)
       goto fail;
@@ -301,18 +405,14 @@ create(char *path, short type, short major, short minor)
   return 0;
 }
 
-uint64
-sys_open(void)
+// Open path for the current process and return the
+// new file descriptor, or -1.
+int
+openpath(char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
-  int n;
-
-  argint(1, &omode);
-  if((n = argstr(0, path, MAXPATH)) < 0)
-    return -1;
 
   begin_op();
 
@@ -328,7 +428,7 @@ sys_open(void)
       return -1;
     }
     ilock(ip);
-    if(ip->type == T_DIR && omode != O_RDONLY){
+    if(ip->type == T_DIR && (omode & ~O_NONBLOCK) != O_RDONLY){
       iunlockput(ip);
       end_op();
       return -1;
@@ -358,6 +458,7 @@ sys_open(void)
   }
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
 
   if((omode & O_TRUNC) && ip->type == T_FILE){
@@ -370,6 +471,18 @@ sys_open(void)
   return fd;
 }
 
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int omode;
+
+  argint(1, &omode);
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  return openpath(path, omode);
+}
+
 uint64
 sys_mkdir(void)
 {
@@ -503,3 +616,79 @@ sys_pipe(void)
   }
   return 0;
 }
+
+// Move up to n bytes from one file descriptor to another
+// inside the kernel.  At least one of them must be a pipe.
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  argint(2, &n);
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0)
+    return -1;
+  if(n < 0 || (in->type != FD_PIPE && out->type != FD_PIPE))
+    return -1;
+  return filesplice(in, out, n);
+}
+
+// Copy up to n bytes of the file open on in_fd to out_fd
+// without going through user space.  If off is non-negative,
+// read from there and leave in_fd's offset alone.
+uint64
+sys_sendfile(void)
+{
+  struct file *in, *out;
+  int off, n;
+
+  argint(2, &off);
+  argint(3, &n);
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0)
+    return -1;
+  if(n < 0)
+    return -1;
+  return filesendfile(out, in, off, n);
+}
+
+// Wait for events on several file descriptors.
+uint64
+sys_poll(void)
+{
+  uint64 fds; // user pointer to array of struct pollfd
+  int nfds, timeout;
+
+  argaddr(0, &fds);
+  argint(1, &nfds);
+  argint(2, &timeout);
+  return poll(fds, nfds, timeout);
+}
+
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  argint(1, &cmd);
+  argint(2, &arg);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filefcntl(f, cmd, arg);
+}
+
+uint64
+sys_ioring_setup(void)
+{
+  return ioring_setup();
+}
+
+uint64
+sys_ioring_enter(void)
+{
+  int to_submit, min_complete;
+
+  argint(0, &to_submit);
+  argint(1, &min_complete);
+  return ioring_enter(to_submit, min_complete);
+}
@@ -114,6 +114,7 @@ usertrapret(void)
   unsigned long x = r_sstatus();
   x &= ~SSTATUS_SPP; // clear SPP to 0 for user mode
   x |= SSTATUS_SPIE; // enable interrupts in user mode
+  x &= ~SSTATUS_VS;  // no vector unit in user mode
   w_sstatus(x);
 
   // set S Exception Program Counter to the saved user pc.
@@ -168,6 +169,7 @@ clockintr()
     ticks++;
     wakeup(&ticks);
     release(&tickslock);
+    polltick();
   }
 
   // ask for the next timer interrupt. this also clears
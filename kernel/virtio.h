@@ -46,8 +46,9 @@
 #define VIRTIO_RING_F_EVENT_IDX     29
 
 // this many virtio descriptors.
-// must be a power of two.
-#define NUM 8
+// must be a power of two.  each disk request takes
+// three, so up to NUM/3 requests can be in flight.
+#define NUM 64
 
 // a single descriptor, from the spec.
 struct virtq_desc {
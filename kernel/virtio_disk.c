@@ -212,12 +212,15 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// Start reading or writing b's data from or to disk block
+// blockno, and return the first descriptor of the request.
+// If there are no free descriptors, return -1 if nowait,
+// and otherwise wait for some.
+// Caller must hold vdisk_lock.
+static int
+virtio_disk_start(struct buf *b, uint blockno, int write, int nowait)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
+  uint64 sector = blockno * (BSIZE / 512);
 
   // the spec's Section 5.2 says that legacy block operations use
   // three descriptors: one for type/reserved/sector, one for the
@@ -229,6 +232,8 @@ virtio_disk_rw(struct buf *b, int write)
     if(alloc3_desc(idx) == 0) {
       break;
     }
+    if(nowait)
+      return -1;
     sleep(&disk.free[0], &disk.vdisk_lock);
   }
 
@@ -280,14 +285,52 @@ virtio_disk_rw(struct buf *b, int write)
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
-  // Wait for virtio_disk_intr() to say request has finished.
+  return idx[0];
+}
+
+// Wait for virtio_disk_intr() to say b's request, which
+// starts at descriptor id, has finished.
+// Caller must hold vdisk_lock.
+static void
+virtio_disk_wait(struct buf *b, int id)
+{
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+  disk.info[id].b = 0;
+  free_chain(id);
+}
+
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  acquire(&disk.vdisk_lock);
+  virtio_disk_wait(b, virtio_disk_start(b, b->blockno, write, 0));
+  release(&disk.vdisk_lock);
+}
 
+// Write the n bufs in bufs, bufs[i] to disk block to[i], with as
+// many of the requests in flight at once as there are descriptors
+// for, and return when all are done.
+void
+virtio_disk_writev(struct buf **bufs, uint *to, int n)
+{
+  int id[NUM];   // requests first..next-1 are in flight
+  int first, next, i;
+
+  acquire(&disk.vdisk_lock);
+  first = next = 0;
+  while(first < n){
+    if(next < n &&
+       (i = virtio_disk_start(bufs[next], to[next], 1, next > first)) >= 0){
+      id[next % NUM] = i;
+      next++;
+    } else {
+      virtio_disk_wait(bufs[first], id[first % NUM]);
+      first++;
+    }
+  }
   release(&disk.vdisk_lock);
 }
 
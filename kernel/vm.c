@@ -37,6 +37,7 @@ kvmmake(void)
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
   // map kernel data and the physical RAM we'll make use of.
+  // kvmmap() uses megapages for all but the start of this.
   kvmmap(kpgtbl, (uint64)etext, (uint64)etext, PHYSTOP-(uint64)etext, PTE_R | PTE_W);
 
   // map the trampoline for trap entry/exit to
@@ -82,6 +83,10 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// A level-1 PTE can also be a leaf (marked PTE_S) that maps
+// a whole 2-megabyte megapage; walk() returns that PTE if it
+// finds one on the way.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
 {
@@ -91,17 +96,86 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   for(int level = 2; level > 0; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
     if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte))
+        return pte;
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
   return &pagetable[PX(0, va)];
 }
 
+// Return the address of the level-1 PTE for va, which maps
+// (or would map) the megapage holding va.  If alloc!=0,
+// create the level-1 page-table page if need be.
+static pte_t *
+walksuper(pagetable_t pagetable, uint64 va, int alloc)
+{
+  pte_t *pte;
+
+  if(va >= MAXVA)
+    panic("walksuper");
+
+  pte = &pagetable[PX(2, va)];
+  if(*pte & PTE_V) {
+    pagetable = (pagetable_t)PTE2PA(*pte);
+  } else {
+    if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
+      return 0;
+    *pte = PA2PTE(pagetable) | PTE_V;
+  }
+  return &pagetable[PX(1, va)];
+}
+
+// The physical address of the page holding va,
+// given the leaf PTE that maps it.
+static uint64
+leafpa(pte_t pte, uint64 va)
+{
+  if(pte & PTE_S)
+    return PTE2PA(pte) + PGROUNDDOWN(va & (SUPERPGSIZE - 1));
+  return PTE2PA(pte);
+}
+
+// Turn the megapage leaf *pte into a pointer to a level-0
+// page table with 512 PTEs for the same memory, so that
+// part of it can be changed.  Returns 0, or -1 if out of memory.
+static int
+demote(pte_t *pte)
+{
+  pagetable_t pt;
+  uint64 pa;
+  int i, flags;
+
+  if((pt = (pagetable_t)kalloc()) == 0)
+    return -1;
+  pa = PTE2PA(*pte);
+  flags = PTE_FLAGS(*pte) & ~PTE_S;
+  for(i = 0; i < 512; i++)
+    pt[i] = PA2PTE(pa + i*PGSIZE) | flags;
+  *pte = PA2PTE(pt) | PTE_V;
+  return 0;
+}
+
+// If va is inside a megapage, and not at its start, demote
+// the megapage so that va is a 4096-byte page boundary.
+// Returns 0, or -1 if out of memory.
+static int
+split(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+
+  if((va % SUPERPGSIZE) == 0)
+    return 0;
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_S) == 0)
+    return 0;
+  return demote(pte);
+}
+
 // Look up a virtual address, return the physical address,
 // or 0 if not mapped.
 // Can only be used to look up user pages.
@@ -121,18 +195,37 @@ walkaddr(pagetable_t pagetable, uint64 va)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  pa = PTE2PA(*pte);
+  pa = leafpa(*pte, va);
   return pa;
 }
 
 // add a mapping to the kernel page table.
 // only used when booting.
 // does not flush TLB or enable paging.
+// whatever part of the range is megapage-aligned in both
+// va and pa is mapped with megapages.
 void
 kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kpgtbl, va, sz, pa, perm) != 0)
-    panic("kvmmap");
+  uint64 n;
+
+  while(sz > 0){
+    if((va % SUPERPGSIZE) == 0 && (pa % SUPERPGSIZE) == 0 && sz >= SUPERPGSIZE){
+      n = sz - sz % SUPERPGSIZE;
+      if(mapsuper(kpgtbl, va, n, pa, perm) != 0)
+        panic("kvmmap");
+    } else {
+      // up to the next megapage boundary.
+      n = SUPERPGSIZE - va % SUPERPGSIZE;
+      if(n > sz)
+        n = sz;
+      if(mappages(kpgtbl, va, n, pa, perm) != 0)
+        panic("kvmmap");
+    }
+    va += n;
+    pa += n;
+    sz -= n;
+  }
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
@@ -171,31 +264,71 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   return 0;
 }
 
+// Create megapage PTEs for virtual addresses starting at va
+// that refer to physical addresses starting at pa.
+// va, pa and size MUST be megapage-aligned.
+// Returns 0 on success, -1 if a page-table page couldn't
+// be allocated.
+int
+mapsuper(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
+{
+  uint64 a;
+  pte_t *pte;
+
+  if((va % SUPERPGSIZE) != 0 || (pa % SUPERPGSIZE) != 0 ||
+     (size % SUPERPGSIZE) != 0 || size == 0)
+    panic("mapsuper: not aligned");
+
+  for(a = va; a < va + size; a += SUPERPGSIZE, pa += SUPERPGSIZE){
+    if((pte = walksuper(pagetable, a, 1)) == 0)
+      return -1;
+    if(*pte & PTE_V)
+      panic("mapsuper: remap");
+    *pte = PA2PTE(pa) | perm | PTE_S | PTE_V;
+  }
+  return 0;
+}
+
 // Remove npages of mappings starting from va. va must be
 // page-aligned. The mappings must exist.
 // Optionally free the physical memory.
-void
+// A megapage that is only partly in the range is split first;
+// returns -1, having removed nothing, if there is no memory
+// for that, and otherwise 0.
+int
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, end;
   pte_t *pte;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
+  end = va + npages*PGSIZE;
+  if(split(pagetable, va) < 0 || split(pagetable, end) < 0)
+    return -1;
+  for(a = va; a < end; a += PGSIZE){
     if((pte = walk(pagetable, a, 0)) == 0)
       panic("uvmunmap: walk");
     if((*pte & PTE_V) == 0)
       panic("uvmunmap: not mapped");
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
+    if(*pte & PTE_S){
+      // split() left only whole megapages in the range.
+      if(do_free)
+        kfree_order((void*)PTE2PA(*pte), SUPERORDER);
+      *pte = 0;
+      a += SUPERPGSIZE - PGSIZE;
+      continue;
+    }
     if(do_free){
       uint64 pa = PTE2PA(*pte);
       kfree((void*)pa);
     }
     *pte = 0;
   }
+  return 0;
 }
 
 // create an empty user page table.
@@ -204,10 +337,9 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -221,8 +353,7 @@ uvmfirst(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("uvmfirst: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
@@ -234,18 +365,32 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 {
   char *mem;
   uint64 a;
+  pte_t *pte;
 
   if(newsz < oldsz)
     return oldsz;
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    // a whole aligned megapage's worth: try to map it as one,
+    // unless an earlier shrink left a level-0 table there.
+    if((a % SUPERPGSIZE) == 0 && newsz - a >= SUPERPGSIZE &&
+       ((pte = walksuper(pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0) &&
+       (mem = kalloc_order(SUPERORDER)) != 0){
+      memset(mem, 0, SUPERPGSIZE);
+      if(mapsuper(pagetable, a, SUPERPGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
+        kfree_order(mem, SUPERORDER);
+        uvmdealloc(pagetable, a, oldsz);
+        return 0;
+      }
+      a += SUPERPGSIZE - PGSIZE;
+      continue;
+    }
+    mem = kalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -258,7 +403,8 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
+// process size, which is oldsz if a megapage had to be split
+// and there was no memory for that.
 uint64
 uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
@@ -267,7 +413,8 @@ uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 
   if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
     int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
-    uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
+    if(uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1) < 0)
+      return oldsz;
   }
 
   return newsz;
@@ -322,8 +469,19 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
       panic("uvmcopy: pte should exist");
     if((*pte & PTE_V) == 0)
       panic("uvmcopy: page not present");
-    pa = PTE2PA(*pte);
-    flags = PTE_FLAGS(*pte);
+    pa = leafpa(*pte, i);
+    flags = PTE_FLAGS(*pte) & ~PTE_S;
+    if((*pte & PTE_S) && (i % SUPERPGSIZE) == 0 &&
+       (mem = kalloc_order(SUPERORDER)) != 0){
+      // copy a megapage as a megapage.
+      memmove(mem, (char*)pa, SUPERPGSIZE);
+      if(mapsuper(new, i, SUPERPGSIZE, (uint64)mem, flags) != 0){
+        kfree_order(mem, SUPERORDER);
+        goto err;
+      }
+      i += SUPERPGSIZE - PGSIZE;
+      continue;
+    }
     if((mem = kalloc()) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
@@ -341,7 +499,9 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
-void
+// Returns 0, or -1 if a megapage had to be split
+// and there was no memory for that.
+int
 uvmclear(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
@@ -349,7 +509,13 @@ uvmclear(pagetable_t pagetable, uint64 va)
   pte = walk(pagetable, va, 0);
   if(pte == 0)
     panic("uvmclear");
+  if(*pte & PTE_S){
+    if(demote(pte) < 0)
+      return -1;
+    pte = walk(pagetable, va, 0);
+  }
   *pte &= ~PTE_U;
+  return 0;
 }
 
 // Copy from kernel to user.
@@ -369,7 +535,7 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
     if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 ||
        (*pte & PTE_W) == 0)
       return -1;
-    pa0 = PTE2PA(*pte);
+    pa0 = leafpa(*pte, va0);
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
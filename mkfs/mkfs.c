@@ -15,14 +15,16 @@
 #define static_assert(a, b) do { switch (0) case 0: case (a): ; } while (0)
 #endif
 
-#define NINODES 200
+#define NINODES 1000  // usertests hashdir makes 2*BSIZE/16
+#define NGROUPS 8
+#define DPB (BSIZE / sizeof(struct dirent))
 
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
 
 int nbitmap = FSSIZE/BPB + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = LOGSIZE + 1;  // header block and LOGSIZE data blocks
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -31,6 +33,8 @@ struct superblock sb;
 char zeroes[BSIZE];
 uint freeinode = 1;
 uint freeblock;
+struct dirent rootde[NINODES];
+int nrootde;
 
 
 void balloc(int);
@@ -40,6 +44,7 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void writedir(uint inum, struct dirent *de, int n);
 void die(const char *);
 
 // convert to riscv byte order
@@ -69,10 +74,9 @@ int
 main(int argc, char *argv[])
 {
   int i, cc, fd;
-  uint rootino, inum, off;
+  uint rootino, inum;
   struct dirent de;
   char buf[BSIZE];
-  struct dinode din;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
@@ -84,6 +88,16 @@ main(int argc, char *argv[])
 
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
+  if(LOGSIZE > LOGMAX){
+    fprintf(stderr, "mkfs: LOGSIZE %d is more than the %d blocks one log header holds\n",
+            LOGSIZE, (int)LOGMAX);
+    exit(1);
+  }
+  if(LOGSIZE < MAXOPBLOCKS){
+    fprintf(stderr, "mkfs: LOGSIZE %d is less than the %d blocks begin_op() reserves\n",
+            LOGSIZE, MAXOPBLOCKS);
+    exit(1);
+  }
 
   fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
   if(fsfd < 0)
@@ -101,6 +115,10 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.datastart = xint(nmeta);
+  sb.ngroups = xint(NGROUPS);
+  sb.groupsize = xint((nblocks + NGROUPS - 1) / NGROUPS);
+  sb.bsize = xint(BSIZE);
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
          nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
@@ -120,12 +138,12 @@ main(int argc, char *argv[])
   bzero(&de, sizeof(de));
   de.inum = xshort(rootino);
   strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
+  rootde[nrootde++] = de;
 
   bzero(&de, sizeof(de));
   de.inum = xshort(rootino);
   strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  rootde[nrootde++] = de;
 
   for(i = 2; i < argc; i++){
     // get rid of "user/"
@@ -154,7 +172,7 @@ main(int argc, char *argv[])
     bzero(&de, sizeof(de));
     de.inum = xshort(inum);
     strncpy(de.name, shortname, DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    rootde[nrootde++] = de;
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -162,12 +180,7 @@ main(int argc, char *argv[])
     close(fd);
   }
 
-  // fix size of root inode dir
-  rinode(rootino, &din);
-  off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
+  writedir(rootino, rootde, nrootde);
 
   balloc(freeblock);
 
@@ -295,6 +308,66 @@ iappend(uint inum, void *xp, int n)
   winode(inum, &din);
 }
 
+int
+hashcmp(const void *a, const void *b)
+{
+  uint x = dirhash(((struct dirent*)a)->name);
+  uint y = dirhash(((struct dirent*)b)->name);
+
+  return x < y ? -1 : x > y;
+}
+
+// Write the n entries de, "." and ".." first, as the
+// contents of directory inum: a linear directory if they
+// fit in one block, a hashed one (see kernel/fs.h) if not.
+void
+writedir(uint inum, struct dirent *de, int n)
+{
+  struct dirent blk[DPB];
+  struct dxentry *dx;
+  struct dinode din;
+  int i, j, nleaf;
+
+  if(n <= DPB){
+    bzero(blk, sizeof(blk));
+    memmove(blk, de, n * sizeof(*de));
+    iappend(inum, blk, BSIZE);
+    return;
+  }
+
+  // leaves half full, so that adding names doesn't split
+  // them right away, without parting equal hashes.
+  qsort(de + 2, n - 2, sizeof(*de), hashcmp);
+  bzero(blk, sizeof(blk));
+  blk[0] = de[0];
+  blk[1] = de[1];
+  dx = (struct dxentry*)&blk[2];
+  nleaf = 0;
+  for(i = 2; i < n; i = j){
+    if(nleaf >= NDX)
+      die("writedir: too many names");
+    dx[nleaf].hash = xint(nleaf == 0 ? 0 : dirhash(de[i].name));
+    dx[nleaf].block = xint(nleaf + 1);
+    nleaf++;
+    for(j = i + 1; j < n && (j - i < DPB/2 ||
+        dirhash(de[j].name) == dirhash(de[j-1].name)); j++)
+      if(j - i >= DPB)
+        die("writedir: too many equal hashes");
+  }
+  iappend(inum, blk, BSIZE);
+  for(i = 2; i < n; i = j){
+    bzero(blk, sizeof(blk));
+    for(j = i; j < n && (j - i < DPB/2 ||
+        dirhash(de[j].name) == dirhash(de[j-1].name)); j++)
+      blk[j - i] = de[j];
+    iappend(inum, blk, BSIZE);
+  }
+
+  rinode(inum, &din);
+  din.major = xshort(DIRHASH);
+  winode(inum, &din);
+}
+
 void
 die(const char *s)
 {
@@ -1,6 +1,7 @@
 #include "kernel/types.h"
 #include "user.h"
 #include "kernel/fcntl.h"
+#include "kernel/uio.h"
 
 #define NULL 0
 #define MAXFILE 71680
@@ -64,17 +65,7 @@ void *reallocateMemory(void *ptr, uint old_size, uint new_size)
     if (new_size <= old_size)
         return ptr;
 
-    void *new_ptr = malloc(new_size);
-    if (new_ptr == NULL)
-        return NULL;
-
-    if (ptr != NULL)
-    {
-        memmove(new_ptr, ptr, old_size);
-        free(ptr);
-    }
-
-    return new_ptr;
+    return realloc(ptr, new_size);
 }
 int createNode(listNode **node, char *line, int i)
 {
@@ -508,6 +499,8 @@ void save(file *f)
 {
 
     listNode *current = f->head;
+    struct iovec iov[IOV_MAX];
+    int n;
 
     // Close the file descriptor
     close(f->fd);
@@ -523,11 +516,16 @@ void save(file *f)
         return;
     }
 
-    // Write the new content to the file
+    // Write the new content to the file, IOV_MAX lines per call
     while (current != NULL)
     {
-        write(f->fd, current->line, strlen(current->line));
-        current = current->next;
+        for (n = 0; n < IOV_MAX && current != NULL; n++)
+        {
+            iov[n].iov_base = current->line;
+            iov[n].iov_len = strlen(current->line);
+            current = current->next;
+        }
+        writev(f->fd, iov, n);
     }
     close(f->fd);
     printf("File saved successfully.\n");
@@ -756,6 +754,7 @@ int handleCommand(char *command, file *f, int not_dirty)
             printf("File has been modified. Save before quitting? (Y/n) ");
 
             char response[2];
+            fflush(stdout);
             read(0, response, sizeof(response));
 
             if (!(response[0] == 'N') && !(response[0] == 'n'))
@@ -857,6 +856,7 @@ int handleCommand(char *command, file *f, int not_dirty)
         range r = parseRange(argv[1], f->line_count);
         printf("Are you sure you want to drop lines %d to %d? (y/N) ", r.begin, r.end);
         char response[2];
+        fflush(stdout);
         read(0, response, sizeof(response));
         if (response[0] == 'Y' || response[0] == 'y')
         {
@@ -884,6 +884,7 @@ int handleCommand(char *command, file *f, int not_dirty)
             printf("File has been modified. Save before quitting? (Y/n) ");
 
             char response[2];
+            fflush(stdout);
             read(0, response, sizeof(response));
 
             if (response[0] == 'Y' || response[0] == 'y')
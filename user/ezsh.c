@@ -27,17 +27,7 @@ void *reallocateMemory(void *ptr, uint old_size, uint new_size)
   if (new_size <= old_size)
     return ptr;
 
-  void *new_ptr = malloc(new_size);
-  if (new_ptr == NULL)
-    return NULL;
-
-  if (ptr != NULL)
-  {
-    memmove(new_ptr, ptr, old_size);
-    free(ptr);
-  }
-
-  return new_ptr;
+  return realloc(ptr, new_size);
 }
 char *find(const char *s, int c)
 {
@@ -100,7 +90,7 @@ char *read_line(void)
   int bufsize = LINE_BUFSIZE;
   int position = 0;
   char *buffer = malloc(sizeof(char) * bufsize);
-  char c;
+  int c;
 
   if (!buffer)
   {
@@ -109,7 +99,7 @@ char *read_line(void)
   }
   while (1)
   {
-    if (read(0, &c, 1) == 0 || c == '\n')
+    if ((c = fgetc(stdin)) == EOF || c == '\n')
     {
       buffer[position] = '\0';
       return buffer;
@@ -0,0 +1,137 @@
+//
+// malloc benchmark.
+// mallocbench [rounds] times a few allocation patterns:
+// random small objects freed in random order, an edit-style
+// list of nodes and lines, and a buffer grown by realloc().
+// uptime() ticks are about a tenth of a second.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NOBJ 2000
+
+void *obj[NOBJ];
+unsigned long seed = 1;
+
+unsigned int
+rand(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) & 0x7fff;
+}
+
+void
+report(char *what, int ops, int t)
+{
+  if(t <= 0)
+    t = 1;
+  printf("%s: %d ops in %d ticks, %d ops/tick\n", what, ops, t, ops / t);
+}
+
+void
+fail(char *what)
+{
+  fprintf(2, "mallocbench: %s failed\n", what);
+  exit(1);
+}
+
+// NOBJ objects of 8 to 263 bytes, each freed and
+// replaced in random order.
+void
+churn(int rounds)
+{
+  int i, j, r, t0;
+
+  t0 = uptime();
+  for(i = 0; i < NOBJ; i++)
+    if((obj[i] = malloc(8 + rand() % 256)) == 0)
+      fail("malloc");
+  for(r = 0; r < rounds; r++){
+    for(i = 0; i < NOBJ; i++){
+      j = rand() % NOBJ;
+      free(obj[j]);
+      if((obj[j] = malloc(8 + rand() % 256)) == 0)
+        fail("malloc");
+    }
+  }
+  for(i = 0; i < NOBJ; i++)
+    free(obj[i]);
+  report("churn", NOBJ * (rounds + 1) * 2, uptime() - t0);
+}
+
+struct node {
+  char *line;
+  struct node *next;
+};
+
+// the pattern of edit: a node and a line buffer
+// per line, all freed at the end.
+void
+lines(int rounds)
+{
+  struct node *head, *n;
+  int i, r, t0;
+
+  t0 = uptime();
+  for(r = 0; r < rounds; r++){
+    head = 0;
+    for(i = 0; i < NOBJ; i++){
+      if((n = malloc(sizeof(*n))) == 0 || (n->line = malloc(20 + rand() % 60)) == 0)
+        fail("malloc");
+      n->next = head;
+      head = n;
+    }
+    while(head){
+      n = head->next;
+      free(head->line);
+      free(head);
+      head = n;
+    }
+  }
+  report("lines", NOBJ * rounds * 4, uptime() - t0);
+}
+
+// grow a buffer 16 bytes at a time up to 32 KB,
+// with a small allocation in between each time.
+void
+grow(int rounds)
+{
+  char *p;
+  int i, r, t0, ops;
+  void *q;
+
+  ops = 0;
+  t0 = uptime();
+  for(r = 0; r < rounds; r++){
+    p = 0;
+    for(i = 16; i <= 32*1024; i += 16){
+      if((p = realloc(p, i)) == 0 || (q = malloc(16)) == 0)
+        fail("realloc");
+      p[i-1] = 1;
+      free(q);
+      ops += 3;
+    }
+    free(p);
+  }
+  report("realloc", ops, uptime() - t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int rounds;
+
+  rounds = 10;
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds <= 0){
+    fprintf(2, "usage: mallocbench [rounds]\n");
+    exit(1);
+  }
+  churn(rounds);
+  lines(rounds);
+  grow(rounds);
+  exit(0);
+}
@@ -0,0 +1,169 @@
+//
+// pipe throughput benchmark.
+// pipebench [MB] measures how fast bytes move through a pipe
+// between two processes for a few read/write sizes, and then
+// how fast a cat file | wc pipeline runs.
+// uptime() ticks are about a tenth of a second.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define FILESZ (200*1024)  // size of the cat | wc input file
+
+char buf[16*1024];
+char *tmpfile = "pipebench.tmp";
+
+// print n bytes in t ticks as MB/s with two decimals.
+void
+report(char *what, int bs, uint64 n, int t)
+{
+  uint64 rate;
+
+  if(t <= 0)
+    t = 1;
+  rate = (n * 10 * 100) / t / (1024*1024);
+  printf("%s bs %d: %ld KB in %d ticks, %ld.%ld%ld MB/s\n", what, bs,
+         n / 1024, t, rate / 100, (rate / 10) % 10, rate % 10);
+}
+
+void
+rawpipe(uint64 total, int bs)
+{
+  int fds[2], pid, t0, t1, n;
+  uint64 got, i;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "pipebench: pipe failed\n");
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pipebench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(i = 0; i < total; i += bs){
+      if(write(fds[1], buf, bs) != bs){
+        fprintf(2, "pipebench: write failed\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  got = 0;
+  while((n = read(fds[0], buf, bs)) > 0)
+    got += n;
+  close(fds[0]);
+  wait(0);
+  t1 = uptime();
+  if(got != total){
+    fprintf(2, "pipebench: read %ld of %ld bytes\n", got, total);
+    exit(1);
+  }
+  report("pipe", bs, got, t1 - t0);
+}
+
+// run argv with fd in as stdin and fd out as stdout.
+int
+spawn(char **argv, int in, int out)
+{
+  int pid;
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pipebench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    if(in != 0){
+      close(0);
+      dup(in);
+    }
+    if(out != 1){
+      close(1);
+      dup(out);
+    }
+    exec(argv[0], argv);
+    fprintf(2, "pipebench: exec %s failed\n", argv[0]);
+    exit(1);
+  }
+  return pid;
+}
+
+void
+catwc(int rounds)
+{
+  char *catargv[] = { "cat", tmpfile, 0 };
+  char *wcargv[] = { "wc", 0 };
+  int fd, fds[2], i, t0, t1, null;
+
+  fd = open(tmpfile, O_CREATE|O_WRONLY|O_TRUNC);
+  if(fd < 0){
+    fprintf(2, "pipebench: cannot create %s\n", tmpfile);
+    exit(1);
+  }
+  memset(buf, 'a', sizeof(buf));
+  for(i = 0; i < sizeof(buf); i += 64)
+    buf[i] = '\n';
+  for(i = 0; i < FILESZ; i += sizeof(buf)){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "pipebench: cannot write %s\n", tmpfile);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  // wc's one line of output per round goes to a scratch file.
+  null = open("pipebench.out", O_CREATE|O_WRONLY|O_TRUNC);
+  if(null < 0){
+    fprintf(2, "pipebench: cannot create pipebench.out\n");
+    exit(1);
+  }
+  t0 = uptime();
+  for(i = 0; i < rounds; i++){
+    if(pipe(fds) < 0){
+      fprintf(2, "pipebench: pipe failed\n");
+      exit(1);
+    }
+    spawn(catargv, 0, fds[1]);
+    spawn(wcargv, fds[0], null);
+    close(fds[0]);
+    close(fds[1]);
+    wait(0);
+    wait(0);
+  }
+  t1 = uptime();
+  close(null);
+  unlink("pipebench.out");
+  unlink(tmpfile);
+  report("cat|wc", FILESZ, (uint64)FILESZ * rounds, t1 - t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint64 total;
+  int mb;
+
+  mb = 8;
+  if(argc > 1)
+    mb = atoi(argv[1]);
+  if(mb <= 0){
+    fprintf(2, "usage: pipebench [MB]\n");
+    exit(1);
+  }
+  total = (uint64)mb * 1024 * 1024;
+
+  rawpipe(total, 512);
+  rawpipe(total, 4096);
+  rawpipe(total, sizeof(buf));
+  catwc(10);
+  exit(0);
+}
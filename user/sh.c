@@ -156,6 +156,10 @@ main(void)
     }
   }
 
+  // Read commands a byte at a time, so that commands
+  // reading the same input see everything after their line.
+  setvbuf(stdin, 0, _IONBF, 0);
+
   // Read and run input commands.
   while(getcmd(buf, sizeof(buf)) >= 0){
     if(buf[0] == 'c' && buf[1] == 'd' && buf[2] == ' '){
@@ -0,0 +1,249 @@
+//
+// Buffered streams over file descriptors.
+// Output to stdout goes out a line at a time when fd 1 is
+// the console and a buffer at a time otherwise, looking
+// again after fd 1 is the target of a dup(); stderr is
+// written at the end of each call.  Pending output is
+// written before the process forks, execs or exits.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+static char inbuf[BUFSIZ], outbuf[BUFSIZ], errbuf[BUFSIZ];
+
+static FILE stdinfile = { 0, -1, 0, inbuf, BUFSIZ, 0, 0, 0 };
+static FILE stdoutfile = { 1, -1, 0, outbuf, BUFSIZ, 0, 0, 0 };
+static FILE stderrfile = { 2, _IONBF, 0, errbuf, BUFSIZ, 0, 0, 0 };
+
+FILE *stdin = &stdinfile;
+FILE *stdout = &stdoutfile;
+FILE *stderr = &stderrfile;
+
+// streams from fdopen(), for fflush(0).
+static FILE *opened;
+
+extern void (*_stdioflush)(void);
+extern void (*_stdiodup)(int);
+
+static void
+flushall(void)
+{
+  fflush(0);
+}
+
+// Choose a buffering mode for fp on first use:
+// lines for the console, whole buffers for anything else.
+static void
+setmode(FILE *fp)
+{
+  struct stat st;
+
+  if(fp->mode >= 0)
+    return;
+  if(fstat(fp->fd, &st) >= 0 && st.type == T_DEVICE)
+    fp->mode = _IOLBF;
+  else
+    fp->mode = _IOFBF;
+  fp->flags |= FILE_AUTO;
+}
+
+// fd is now a copy of another file: streams on it whose
+// mode setmode() chose must choose again.
+static void
+dupped(int fd)
+{
+  FILE *fp;
+
+  if(stdin->fd == fd && (stdin->flags & FILE_AUTO))
+    stdin->mode = -1;
+  if(stdout->fd == fd && (stdout->flags & FILE_AUTO))
+    stdout->mode = -1;
+  for(fp = opened; fp; fp = fp->next)
+    if(fp->fd == fd && (fp->flags & FILE_AUTO))
+      fp->mode = -1;
+}
+
+int
+setvbuf(FILE *fp, char *buf, int mode, uint size)
+{
+  if(mode != _IOFBF && mode != _IOLBF && mode != _IONBF)
+    return -1;
+  if(fflush(fp) < 0)
+    return -1;
+  if(buf && size > 0){
+    fp->buf = buf;
+    fp->size = size;
+  }
+  fp->mode = mode;
+  fp->flags &= ~FILE_AUTO;
+  return 0;
+}
+
+FILE*
+fdopen(int fd, const char *mode)
+{
+  FILE *fp;
+
+  if(fd < 0 || (mode[0] != 'r' && mode[0] != 'w'))
+    return 0;
+  if((fp = malloc(sizeof(FILE) + BUFSIZ)) == 0)
+    return 0;
+  memset(fp, 0, sizeof(FILE));
+  fp->fd = fd;
+  fp->mode = -1;
+  fp->buf = (char*)(fp + 1);
+  fp->size = BUFSIZ;
+  fp->next = opened;
+  opened = fp;
+  return fp;
+}
+
+int
+fclose(FILE *fp)
+{
+  FILE **pp;
+  int r;
+
+  r = fflush(fp);
+  if(close(fp->fd) < 0)
+    r = EOF;
+  for(pp = &opened; *pp; pp = &(*pp)->next){
+    if(*pp == fp){
+      *pp = fp->next;
+      free(fp);
+      break;
+    }
+  }
+  return r;
+}
+
+// Write out fp's pending output; fflush(0) does
+// every stream.  Returns 0, or EOF on error.
+int
+fflush(FILE *fp)
+{
+  int i, n, r;
+
+  if(fp == 0){
+    r = fflush(stdout) | fflush(stderr);
+    for(fp = opened; fp; fp = fp->next)
+      r |= fflush(fp);
+    return r ? EOF : 0;
+  }
+  if(fp->reading){
+    // drop buffered input.
+    fp->pos = fp->len = 0;
+    fp->reading = 0;
+    return 0;
+  }
+  for(i = 0; i < fp->len; i += n){
+    if((n = write(fp->fd, fp->buf + i, fp->len - i)) <= 0){
+      fp->len = 0;
+      fp->flags |= FILE_ERR;
+      return EOF;
+    }
+  }
+  fp->len = 0;
+  return 0;
+}
+
+int
+fputc(int c, FILE *fp)
+{
+  if(fp->reading)
+    fflush(fp);
+  setmode(fp);
+  _stdioflush = flushall;
+  _stdiodup = dupped;
+  fp->buf[fp->len++] = c;
+  if(fp->len == fp->size || (fp->mode == _IOLBF && c == '\n'))
+    return fflush(fp) < 0 ? EOF : (c & 0xff);
+  return c & 0xff;
+}
+
+// Write n bytes from p to fp, as one call: an
+// unbuffered stream gets them in one write().
+int
+fwrite(const void *p, int n, FILE *fp)
+{
+  const char *s = p;
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(fputc(s[i], fp) == EOF)
+      break;
+  if(fp->mode == _IONBF && fflush(fp) < 0)
+    return -1;
+  return i;
+}
+
+int
+fputs(const char *s, FILE *fp)
+{
+  return fwrite(s, strlen(s), fp) < 0 ? EOF : 0;
+}
+
+int
+fgetc(FILE *fp)
+{
+  int n;
+
+  if(!fp->reading){
+    fflush(fp);
+    fp->reading = 1;
+  }
+  if(fp->pos == fp->len){
+    // let the user see any prompt before waiting for input.
+    if(fp == stdin)
+      fflush(stdout);
+    setmode(fp);
+    _stdiodup = dupped;
+    n = read(fp->fd, fp->buf, fp->mode == _IONBF ? 1 : fp->size);
+    if(n <= 0){
+      fp->flags |= (n == 0 ? FILE_EOF : FILE_ERR);
+      return EOF;
+    }
+    fp->pos = 0;
+    fp->len = n;
+  }
+  return fp->buf[fp->pos++] & 0xff;
+}
+
+// Read a line of at most max-1 characters into buf,
+// keeping the newline.  Returns 0 at end of file.
+char*
+fgets(char *buf, int max, FILE *fp)
+{
+  int i, c;
+
+  for(i = 0; i+1 < max; ){
+    if((c = fgetc(fp)) == EOF)
+      break;
+    buf[i++] = c;
+    if(c == '\n' || c == '\r')
+      break;
+  }
+  buf[i] = '\0';
+  return i > 0 ? buf : 0;
+}
+
+int
+feof(FILE *fp)
+{
+  return (fp->flags & FILE_EOF) != 0;
+}
+
+int
+ferror(FILE *fp)
+{
+  return (fp->flags & FILE_ERR) != 0;
+}
+
+char*
+gets(char *buf, int max)
+{
+  fgets(buf, max, stdin);
+  return buf;
+}
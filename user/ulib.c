@@ -14,6 +14,56 @@ start()
   exit(0);
 }
 
+int _fork(void);
+int _exec(const char*, char**);
+int _exit(int) __attribute__((noreturn));
+int _dup(int);
+
+// Set by stdio.c once it has buffered output, which
+// must be written before this image goes away, and
+// before a fork() so that the child doesn't write
+// it a second time.
+void (*_stdioflush)(void);
+
+// Set by stdio.c, and called with the new fd after a dup(),
+// since that fd may now be a different kind of file.
+void (*_stdiodup)(int);
+
+int
+fork(void)
+{
+  if(_stdioflush)
+    _stdioflush();
+  return _fork();
+}
+
+int
+dup(int fd)
+{
+  int r;
+
+  r = _dup(fd);
+  if(r >= 0 && _stdiodup)
+    _stdiodup(r);
+  return r;
+}
+
+int
+exec(const char *path, char **argv)
+{
+  if(_stdioflush)
+    _stdioflush();
+  return _exec(path, argv);
+}
+
+int
+exit(int status)
+{
+  if(_stdioflush)
+    _stdioflush();
+  _exit(status);
+}
+
 char*
 strcpy(char *s, const char *t)
 {
@@ -63,24 +113,6 @@ strchr(const char *s, char c)
   return 0;
 }
 
-char*
-gets(char *buf, int max)
-{
-  int i, cc;
-  char c;
-
-  for(i=0; i+1 < max; ){
-    cc = read(0, &c, 1);
-    if(cc < 1)
-      break;
-    buf[i++] = c;
-    if(c == '\n' || c == '\r')
-      break;
-  }
-  buf[i] = '\0';
-  return buf;
-}
-
 int
 stat(const char *n, struct stat *st)
 {
@@ -3,88 +3,239 @@
 #include "user/user.h"
 #include "kernel/param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator with size-class bins.
+//
+// Memory comes from sbrk() in chunks and is cut into
+// blocks, each with a header.  Blocks of up to NSMALL
+// units go back, when freed, to an exact-size bin and are
+// reused as they are, with no searching and no splitting.
+// Bigger blocks are coalesced with free neighbours through
+// boundary sizes in the headers, and kept on lists by
+// power-of-two size.
+
+#define NSMALL  32    // largest block, in units, kept in a bin
+#define NLARGE  32    // lists of free large blocks, by log2(size)
+#define NCORE   4096  // units to ask sbrk() for at least
 
 typedef long Align;
 
 union header {
   struct {
-    union header *ptr;
-    uint size;
+    uint size;      // of this block in units, including the header
+    uint prevsize;  // of the block just below, or 0 at a chunk start
+    uint inuse;     // allocated, or sitting in a small bin
   } s;
-  Align x;
+  Align x[2];
 };
 
 typedef union header Header;
 
-static Header base;
-static Header *freep;
+// the body of a free large block.
+struct link {
+  Header *next;
+  Header *prev;
+};
+
+static Header *bins[NSMALL+1];   // bins[n]: free blocks of n units
+static Header *lists[NLARGE];    // free large blocks
+static Header *fence;            // end of the last chunk
+
+#define LINK(h)   ((struct link*)((h) + 1))
+#define NEXT(h)   ((h) + (h)->s.size)
+#define PREV(h)   ((h) - (h)->s.prevsize)
+
+static int
+listno(uint size)
+{
+  int i;
+
+  for(i = 0; size > 1 && i < NLARGE-1; i++)
+    size >>= 1;
+  return i;
+}
+
+static void
+insert(Header *h)
+{
+  Header **lp = &lists[listno(h->s.size)];
+
+  h->s.inuse = 0;
+  LINK(h)->prev = 0;
+  LINK(h)->next = *lp;
+  if(*lp)
+    LINK(*lp)->prev = h;
+  *lp = h;
+}
+
+static void
+detach(Header *h)
+{
+  if(LINK(h)->prev)
+    LINK(LINK(h)->prev)->next = LINK(h)->next;
+  else
+    lists[listno(h->s.size)] = LINK(h)->next;
+  if(LINK(h)->next)
+    LINK(LINK(h)->next)->prev = LINK(h)->prev;
+}
+
+// Cut h, which is in use, down to nunits and put the
+// rest on a list, if the rest is big enough to be a block.
+// The block after h must be in use, so the rest can't
+// have a free neighbour to coalesce with.
+static void
+trim(Header *h, uint nunits)
+{
+  Header *r;
+
+  if(h->s.size < nunits + 2)
+    return;
+  r = h + nunits;
+  r->s.size = h->s.size - nunits;
+  r->s.prevsize = nunits;
+  NEXT(r)->s.prevsize = r->s.size;
+  h->s.size = nunits;
+  insert(r);
+}
+
+// Get a new chunk of at least nunits from the kernel, ending
+// in a one-unit fence that is always in use.  A chunk that
+// starts right after the last one takes over its fence, so
+// that free space can coalesce across the two.
+static int
+morecore(uint nunits)
+{
+  Header *h;
+  char *p;
+
+  nunits += 1;
+  if(nunits < NCORE)
+    nunits = NCORE;
+  p = sbrk(nunits * sizeof(Header));
+  if(p == (char*)-1)
+    return -1;
+  h = (Header*)p;
+  if(fence && h == fence + 1){
+    h = fence;
+  } else {
+    h->s.prevsize = 0;
+    nunits -= 1;
+  }
+  h->s.size = nunits;
+  h->s.inuse = 1;
+  fence = NEXT(h);
+  fence->s.size = 1;
+  fence->s.prevsize = h->s.size;
+  fence->s.inuse = 1;
+  free((void*)(h + 1));
+  return 0;
+}
 
 void
 free(void *ap)
 {
-  Header *bp, *p;
-
-  bp = (Header*)ap - 1;
-  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if(bp + bp->s.size == p->s.ptr){
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
-  } else
-    bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
-  } else
-    p->s.ptr = bp;
-  freep = p;
+  Header *h, *n;
+
+  if(ap == 0)
+    return;
+  h = (Header*)ap - 1;
+  if(h->s.size <= NSMALL){
+    *(Header**)(h + 1) = bins[h->s.size];
+    bins[h->s.size] = h;
+    return;
+  }
+
+  n = NEXT(h);
+  if(!n->s.inuse){
+    detach(n);
+    h->s.size += n->s.size;
+  }
+  if(h->s.prevsize && !PREV(h)->s.inuse){
+    n = PREV(h);
+    detach(n);
+    n->s.size += h->s.size;
+    h = n;
+  }
+  NEXT(h)->s.prevsize = h->s.size;
+  insert(h);
 }
 
+// Take a free block of at least nunits off the lists:
+// the first that fits in nunits' own list, or else any
+// block from a list of bigger ones.
 static Header*
-morecore(uint nu)
+take(uint nunits)
 {
-  char *p;
-  Header *hp;
+  Header *h;
+  int i;
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
-  if(p == (char*)-1)
-    return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
-  return freep;
+  i = listno(nunits);
+  for(h = lists[i]; h; h = LINK(h)->next)
+    if(h->s.size >= nunits)
+      goto found;
+  for(i++; i < NLARGE; i++)
+    if((h = lists[i]) != 0)
+      goto found;
+  return 0;
+
+found:
+  detach(h);
+  h->s.inuse = 1;
+  return h;
 }
 
 void*
 malloc(uint nbytes)
 {
-  Header *p, *prevp;
+  Header *h;
   uint nunits;
 
   nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
+  if(nunits < 2)
+    nunits = 2;
+  if(nunits <= NSMALL && (h = bins[nunits]) != 0){
+    bins[nunits] = *(Header**)(h + 1);
+    return (void*)(h + 1);
+  }
+  if((h = take(nunits)) == 0){
+    if(morecore(nunits) < 0 || (h = take(nunits)) == 0)
+      return 0;
   }
-  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){
-      if(p->s.size == nunits)
-        prevp->s.ptr = p->s.ptr;
-      else {
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
-      }
-      freep = prevp;
-      return (void*)(p + 1);
-    }
-    if(p == freep)
-      if((p = morecore(nunits)) == 0)
-        return 0;
+  trim(h, nunits);
+  return (void*)(h + 1);
+}
+
+// Resize the block at ap to nbytes, in place if the
+// block or the free space after it is big enough.
+void*
+realloc(void *ap, uint nbytes)
+{
+  Header *h, *n;
+  uint nunits;
+  void *p;
+
+  if(ap == 0)
+    return malloc(nbytes);
+  if(nbytes == 0){
+    free(ap);
+    return 0;
+  }
+  h = (Header*)ap - 1;
+  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  if(nunits <= h->s.size)
+    return ap;
+
+  n = NEXT(h);
+  if(!n->s.inuse && h->s.size + n->s.size >= nunits){
+    detach(n);
+    h->s.size += n->s.size;
+    NEXT(h)->s.prevsize = h->s.size;
+    trim(h, nunits);
+    return ap;
   }
+
+  if((p = malloc(nbytes)) == 0)
+    return 0;
+  memmove(p, ap, (h->s.size - 1) * sizeof(Header));
+  free(ap);
+  return p;
 }
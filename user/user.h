@@ -1,4 +1,7 @@
 struct stat;
+struct pollfd;
+struct ioring;
+struct iovec;
 
 // system calls
 int fork(void);
@@ -22,6 +25,16 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int splice(int, int, int);
+int sendfile(int, int, int, int);
+int poll(struct pollfd*, int, int);
+int fcntl(int, int, int);
+struct ioring* ioring_setup(void);
+int ioring_enter(int, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -31,7 +44,6 @@ char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
 void fprintf(int, const char*, ...) __attribute__ ((format (printf, 2, 3)));
 void printf(const char*, ...) __attribute__ ((format (printf, 1, 2)));
-char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
 int atoi(const char*);
@@ -41,3 +53,42 @@ void *memcpy(void *, const void *, uint);
 // umalloc.c
 void* malloc(uint);
 void free(void*);
+void* realloc(void*, uint);
+
+// stdio.c
+#define EOF     (-1)
+#define BUFSIZ  512
+#define _IOFBF  0  // write when the buffer fills
+#define _IOLBF  1  // also write at each newline
+#define _IONBF  2  // write at the end of each call
+
+#define FILE_EOF 0x1
+#define FILE_ERR 0x2
+#define FILE_AUTO 0x4   // mode was chosen by looking at fd
+
+typedef struct FILE {
+  int fd;
+  int mode;       // _IOFBF, _IOLBF, _IONBF, or -1 until first use
+  int flags;      // FILE_EOF, FILE_ERR, FILE_AUTO
+  char *buf;
+  int size;       // of buf
+  int pos;        // next byte of input in buf
+  int len;        // bytes in buf
+  int reading;    // buf holds input rather than output
+  struct FILE *next;
+} FILE;
+
+extern FILE *stdin, *stdout, *stderr;
+
+FILE* fdopen(int, const char*);
+int fclose(FILE*);
+int fflush(FILE*);
+int setvbuf(FILE*, char*, int, uint);
+int fputc(int, FILE*);
+int fputs(const char*, FILE*);
+int fwrite(const void*, int, FILE*);
+int fgetc(FILE*);
+char* fgets(char*, int, FILE*);
+int feof(FILE*);
+int ferror(FILE*);
+char* gets(char*, int max);
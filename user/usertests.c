@@ -7,6 +7,9 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/poll.h"
+#include "kernel/ioring.h"
+#include "kernel/uio.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -19,6 +22,10 @@
 
 #define BUFSZ  ((MAXOPBLOCKS+2)*BSIZE)
 
+// the size the kernel's inode table had when it was a fixed
+// array; iref still goes past it, to catch leaked references.
+#define NINODE 50
+
 char buf[BUFSZ];
 
 //
@@ -789,6 +796,1118 @@ pipe1(char *s)
 }
 
 
+// the writer fills the pipe's ring, the reader takes a bit more
+// than half of it, and the writer's next write wraps around the
+// end of the ring and then has to grow it.  So each time the ring
+// grows, the unread data starts in the middle of a page and wraps.
+void
+pipebig(char *s)
+{
+  int fds[2], ready[2], go[2], pid, xstatus;
+  int i, n, m, total, ring;
+  char *p, c;
+  enum { SZ=128*1024 };
+
+  if(pipe(fds) != 0 || pipe(ready) != 0 || pipe(go) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork() failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    p = sbrk(SZ);
+    for(i = 0; i < SZ; i++)
+      p[i] = i % 251;
+    // fill the one-page ring; then, each time the reader has
+    // taken ring/2+100 bytes, fill that and another ring's worth.
+    n = PGSIZE;
+    for(ring = PGSIZE; ; ring *= 2){
+      if(write(fds[1], p, n) != n){
+        printf("%s: pipebig write failed\n", s);
+        exit(1);
+      }
+      p += n;
+      if(ring == PIPEMAXPAGES*PGSIZE)
+        break;
+      if(write(ready[1], "x", 1) != 1 || read(go[0], &c, 1) != 1){
+        printf("%s: pipebig handshake failed\n", s);
+        exit(1);
+      }
+      n = ring/2 + 100 + ring;
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  total = 0;
+  for(ring = PGSIZE; ring < PIPEMAXPAGES*PGSIZE; ring *= 2){
+    if(read(ready[0], &c, 1) != 1){
+      printf("%s: pipebig handshake failed\n", s);
+      exit(1);
+    }
+    for(m = ring/2 + 100; m > 0; m -= n){
+      if((n = read(fds[0], buf, m < BUFSZ ? m : BUFSZ)) <= 0){
+        printf("%s: pipebig read failed\n", s);
+        exit(1);
+      }
+      for(i = 0; i < n; i++){
+        if((buf[i] & 0xff) != (total + i) % 251){
+          printf("%s: pipebig wrong byte at %d\n", s, total + i);
+          exit(1);
+        }
+      }
+      total += n;
+    }
+    if(write(go[1], "x", 1) != 1){
+      printf("%s: pipebig handshake failed\n", s);
+      exit(1);
+    }
+  }
+  while((n = read(fds[0], buf, 3000)) > 0){
+    for(i = 0; i < n; i++){
+      if((buf[i] & 0xff) != (total + i) % 251){
+        printf("%s: pipebig wrong byte at %d\n", s, total + i);
+        exit(1);
+      }
+    }
+    total += n;
+  }
+  close(fds[0]);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  // PGSIZE, then 3*ring/2+100 for each ring size before the last.
+  n = PGSIZE;
+  for(ring = PGSIZE; ring < PIPEMAXPAGES*PGSIZE; ring *= 2)
+    n += ring/2 + 100 + ring;
+  if(total != n){
+    printf("%s: pipebig total %d, not %d\n", s, total, n);
+    exit(1);
+  }
+}
+
+
+// splice() file -> pipe -> pipe -> file, and check the result.
+void
+splicetest(char *s)
+{
+  int fd, p1[2], p2[2], i, j, n, off, tot;
+  enum { SZ=3*BSIZE+17 };
+
+  unlink("splice0");
+  unlink("splice1");
+  fd = open("splice0", O_CREATE|O_WRONLY);
+  if(fd < 0){
+    printf("%s: open splice0 failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = 'a' + i % 26;
+  if(write(fd, buf, SZ) != SZ){
+    printf("%s: write splice0 failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(pipe(p1) < 0 || pipe(p2) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  fd = open("splice0", O_RDONLY);
+  if((n = splice(fd, p1[1], SZ)) != SZ){
+    printf("%s: splice file->pipe returned %d\n", s, n);
+    exit(1);
+  }
+  close(fd);
+  close(p1[1]);
+  if((n = splice(p1[0], p2[1], SZ)) != SZ){
+    printf("%s: splice pipe->pipe returned %d\n", s, n);
+    exit(1);
+  }
+  close(p1[0]);
+  close(p2[1]);
+  fd = open("splice1", O_CREATE|O_WRONLY);
+  if((n = splice(p2[0], fd, SZ)) != SZ){
+    printf("%s: splice pipe->file returned %d\n", s, n);
+    exit(1);
+  }
+  if(splice(p2[0], fd, SZ) != 0){
+    printf("%s: splice past end of pipe\n", s);
+    exit(1);
+  }
+  close(p2[0]);
+  close(fd);
+
+  // neither end is a pipe.
+  fd = open("splice1", O_RDONLY);
+  if(splice(fd, 1, 10) != -1){
+    printf("%s: splice file->console succeeded\n", s);
+    exit(1);
+  }
+  memset(buf, 0, SZ);
+  if(read(fd, buf, SZ+1) != SZ){
+    printf("%s: splice1 has the wrong size\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(i = 0; i < SZ; i++){
+    if(buf[i] != 'a' + i % 26){
+      printf("%s: splice1 wrong byte at %d\n", s, i);
+      exit(1);
+    }
+  }
+  unlink("splice0");
+  unlink("splice1");
+
+  // a file twice the size of the biggest pipe, spliced into a
+  // nonblocking pipe: each splice() moves what fits, and the
+  // rest must still be in the file for the next one.
+  enum { BIG=2*PIPEMAXPAGES*PGSIZE, CHUNK=BUFSZ - BUFSZ % 26 };
+  fd = open("splice2", O_CREATE|O_WRONLY);
+  if(fd < 0){
+    printf("%s: open splice2 failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < CHUNK; i++)
+    buf[i] = 'a' + i % 26;
+  for(tot = 0; tot < BIG; tot += CHUNK){
+    if(write(fd, buf, CHUNK) != CHUNK){
+      printf("%s: write splice2 failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  fd = open("splice2", O_RDONLY);
+  if(pipe(p1) < 0 || fcntl(p1[1], F_SETFL, O_NONBLOCK) != 0){
+    printf("%s: nonblocking pipe failed\n", s);
+    exit(1);
+  }
+  for(off = 0; off < tot; ){
+    n = splice(fd, p1[1], tot - off);
+    if(n <= 0 || n > PIPEMAXPAGES*PGSIZE){
+      printf("%s: splice into nonblocking pipe returned %d\n", s, n);
+      exit(1);
+    }
+    for(; n > 0; n -= i, off += i){
+      if((i = read(p1[0], buf, n < BUFSZ ? n : BUFSZ)) <= 0){
+        printf("%s: read spliced pipe failed\n", s);
+        exit(1);
+      }
+      for(j = 0; j < i; j++){
+        if(buf[j] != 'a' + (off + j) % 26){
+          printf("%s: spliced pipe wrong byte at %d\n", s, off + j);
+          exit(1);
+        }
+      }
+    }
+  }
+  if(splice(fd, p1[1], 10) != 0){
+    printf("%s: splice past end of splice2\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("splice2");
+
+  // a pipe's bytes can't be put back, so splicing them into a
+  // full nonblocking pipe must take none of them.
+  while(write(p1[1], buf, BUFSZ) > 0)
+    ;
+  if(pipe(p2) < 0 || write(p2[1], "xyz", 3) != 3){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  if((n = splice(p2[0], p1[1], 3)) != -EAGAIN){
+    printf("%s: splice into full pipe returned %d\n", s, n);
+    exit(1);
+  }
+  if(read(p2[0], buf, 3) != 3 || buf[0] != 'x' || buf[2] != 'z'){
+    printf("%s: splice into full pipe lost bytes\n", s);
+    exit(1);
+  }
+  close(p1[0]);
+  close(p1[1]);
+  close(p2[0]);
+  close(p2[1]);
+}
+
+// sendfile() between two files, with and without an
+// explicit offset, and from a file into a pipe.
+void
+sendfiletest(char *s)
+{
+  int in, out, fds[2], i, n;
+  enum { SZ=(MAXOPBLOCKS+1)*BSIZE+5 };
+
+  unlink("sendfile0");
+  unlink("sendfile1");
+  in = open("sendfile0", O_CREATE|O_RDWR);
+  if(in < 0){
+    printf("%s: open sendfile0 failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = i % 199;
+  if(write(in, buf, SZ) != SZ){
+    printf("%s: write sendfile0 failed\n", s);
+    exit(1);
+  }
+  close(in);
+
+  in = open("sendfile0", O_RDONLY);
+  out = open("sendfile1", O_CREATE|O_RDWR);
+  if((n = sendfile(out, in, -1, SZ + 100)) != SZ){
+    printf("%s: sendfile file->file returned %d\n", s, n);
+    exit(1);
+  }
+  if(sendfile(out, in, -1, 10) != 0){
+    printf("%s: sendfile past end of file\n", s);
+    exit(1);
+  }
+  // an explicit offset doesn't move in's offset.
+  if((n = sendfile(out, in, 7, 3)) != 3){
+    printf("%s: sendfile at offset returned %d\n", s, n);
+    exit(1);
+  }
+  if(sendfile(in, out, -1, 1) != -1){
+    printf("%s: sendfile to a read-only file succeeded\n", s);
+    exit(1);
+  }
+  close(in);
+  close(out);
+
+  out = open("sendfile1", O_RDONLY);
+  if(read(out, buf, sizeof(buf)) != SZ + 3){
+    printf("%s: sendfile1 has the wrong size\n", s);
+    exit(1);
+  }
+  close(out);
+  for(i = 0; i < SZ + 3; i++){
+    if((buf[i] & 0xff) != (i < SZ ? i : i - SZ + 7) % 199){
+      printf("%s: sendfile1 wrong byte at %d\n", s, i);
+      exit(1);
+    }
+  }
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  in = open("sendfile0", O_RDONLY);
+  if((n = sendfile(fds[1], in, 100, 50)) != 50){
+    printf("%s: sendfile file->pipe returned %d\n", s, n);
+    exit(1);
+  }
+  if(read(fds[0], buf, 50) != 50 || (buf[0] & 0xff) != 100){
+    printf("%s: sendfile file->pipe wrong data\n", s);
+    exit(1);
+  }
+  close(in);
+  close(fds[0]);
+  close(fds[1]);
+
+  // only a regular file can be the source.
+  in = open(".", O_RDONLY);
+  out = open("sendfile1", O_WRONLY);
+  if(sendfile(out, in, 0, 10) != -1){
+    printf("%s: sendfile from a directory succeeded\n", s);
+    exit(1);
+  }
+  close(in);
+  close(out);
+  unlink("sendfile0");
+  unlink("sendfile1");
+}
+
+// poll() on the read ends of two pipes, only one
+// of which a child writes to.
+void
+polltest(char *s)
+{
+  int a[2], b[2], pid, n, xstatus;
+  struct pollfd fds[3];
+
+  if(pipe(a) < 0 || pipe(b) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  fds[0].fd = a[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = b[0];
+  fds[1].events = POLLIN;
+  fds[2].fd = -1;
+  if((n = poll(fds, 3, 0)) != 0){
+    printf("%s: poll of empty pipes returned %d\n", s, n);
+    exit(1);
+  }
+  if((n = poll(fds, 2, 2)) != 0){
+    printf("%s: poll timeout returned %d\n", s, n);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork() failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(2);
+    write(b[1], "x", 1);
+    exit(0);
+  }
+  if((n = poll(fds, 3, -1)) != 1 || fds[0].revents != 0 ||
+     fds[1].revents != POLLIN || fds[2].revents != 0){
+    printf("%s: poll returned %d, revents %x %x\n", s, n,
+           fds[0].revents, fds[1].revents);
+    exit(1);
+  }
+  wait(&xstatus);
+
+  // end of file on a, room to write on b.
+  close(a[1]);
+  fds[1].fd = b[1];
+  fds[1].events = POLLOUT;
+  if((n = poll(fds, 2, 0)) != 2 || fds[0].revents != (POLLIN|POLLHUP) ||
+     fds[1].revents != POLLOUT){
+    printf("%s: poll of closed pipe returned %d\n", s, n);
+    exit(1);
+  }
+  fds[0].fd = a[1];
+  if(poll(fds, 1, 0) != 1 || fds[0].revents != POLLNVAL){
+    printf("%s: poll of closed fd\n", s);
+    exit(1);
+  }
+  close(a[0]);
+  close(b[0]);
+  close(b[1]);
+  exit(xstatus);
+}
+
+// O_NONBLOCK pipes return -EAGAIN instead of waiting.
+void
+nonblocktest(char *s)
+{
+  int fds[2], n, total;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[0], F_GETFL, 0) != O_RDONLY){
+    printf("%s: F_GETFL of new pipe\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[0], F_SETFL, O_NONBLOCK) != 0 ||
+     fcntl(fds[1], F_SETFL, O_NONBLOCK) != 0 ||
+     fcntl(fds[1], F_GETFL, 0) != (O_WRONLY|O_NONBLOCK)){
+    printf("%s: F_SETFL failed\n", s);
+    exit(1);
+  }
+  if((n = read(fds[0], buf, 1)) != -EAGAIN){
+    printf("%s: read of empty pipe returned %d\n", s, n);
+    exit(1);
+  }
+
+  // fill the pipe until it won't grow any more.
+  total = 0;
+  while((n = write(fds[1], buf, BSIZE)) > 0)
+    total += n;
+  if(n != -EAGAIN || total < PGSIZE){
+    printf("%s: write to full pipe returned %d after %d\n", s, n, total);
+    exit(1);
+  }
+  while((n = read(fds[0], buf, BSIZE)) > 0)
+    total -= n;
+  if(n != -EAGAIN || total != 0){
+    printf("%s: drained pipe returned %d, %d left\n", s, n, total);
+    exit(1);
+  }
+
+  close(fds[1]);
+  if((n = read(fds[0], buf, 1)) != 0){
+    printf("%s: read at end of file returned %d\n", s, n);
+    exit(1);
+  }
+  close(fds[0]);
+}
+
+// queue one submission on ring r.
+void
+iosubmit(struct ioring *r, int op, int fd, uint64 addr, int n, uint64 data)
+{
+  struct io_sqe *sqe = &r->sq[r->sqtail % IORING_NSQE];
+
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->addr = addr;
+  sqe->n = n;
+  sqe->data = data;
+  __sync_synchronize();
+  r->sqtail++;
+}
+
+// take the next completion from ring r, checking its data.
+int
+iocomplete(char *s, struct ioring *r, uint64 data)
+{
+  struct io_cqe *cqe;
+
+  if(r->cqhead == r->cqtail){
+    printf("%s: no completion for %ld\n", s, data);
+    exit(1);
+  }
+  __sync_synchronize();
+  cqe = &r->cq[r->cqhead % IORING_NCQE];
+  if(cqe->data != data){
+    printf("%s: completion for %ld, expected %ld\n", s, cqe->data, data);
+    exit(1);
+  }
+  r->cqhead++;
+  return cqe->res;
+}
+
+// opens, writes, reads and stats through the submission ring.
+void
+ioringtest(char *s)
+{
+  struct ioring *r;
+  struct stat st;
+  char *file = "ioring.tmp";
+  int fd, fds[2], i, n, pid, xstatus;
+
+  r = ioring_setup();
+  if(r == (struct ioring*)-1 || ioring_setup() != r){
+    printf("%s: ioring_setup failed\n", s);
+    exit(1);
+  }
+
+  iosubmit(r, IORING_OP_OPEN, 0, (uint64)file, O_CREATE|O_RDWR, 1);
+  if(ioring_enter(1, 1) != 1 || (fd = iocomplete(s, r, 1)) < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+
+  // the write and the fstat run in order on the worker.
+  for(i = 0; i < 5000; i++)
+    buf[i] = i;
+  iosubmit(r, IORING_OP_WRITE, fd, (uint64)buf, 5000, 2);
+  iosubmit(r, IORING_OP_FSTAT, fd, (uint64)&st, 0, 3);
+  if(ioring_enter(2, 2) != 2){
+    printf("%s: ioring_enter failed\n", s);
+    exit(1);
+  }
+  if((n = iocomplete(s, r, 2)) != 5000 || iocomplete(s, r, 3) != 0 || st.size != 5000){
+    printf("%s: write returned %d, size %ld\n", s, n, st.size);
+    exit(1);
+  }
+  iosubmit(r, IORING_OP_CLOSE, fd, 0, 0, 4);
+  iosubmit(r, IORING_OP_READ, fd, (uint64)buf, 1, 5);
+  ioring_enter(2, 2);
+  if(iocomplete(s, r, 4) != 0 || iocomplete(s, r, 5) != -1){
+    printf("%s: close or read of closed fd\n", s);
+    exit(1);
+  }
+
+  memset(buf, 0, 5000);
+  fd = open(file, O_RDONLY);
+  iosubmit(r, IORING_OP_READ, fd, (uint64)buf, 5000, 6);
+  ioring_enter(1, 1);
+  if((n = iocomplete(s, r, 6)) != 5000){
+    printf("%s: read returned %d\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i < 5000; i++){
+    if(buf[i] != (char)i){
+      printf("%s: wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink(file);
+
+  // a read of an empty pipe completes once data arrives.
+  if(pipe(fds) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  iosubmit(r, IORING_OP_READ, fds[0], (uint64)buf, 100, 7);
+  if(ioring_enter(1, 0) != 1 || r->cqhead != r->cqtail){
+    printf("%s: pipe read completed early\n", s);
+    exit(1);
+  }
+  write(fds[1], "hello", 5);
+  ioring_enter(0, 1);
+  if((n = iocomplete(s, r, 7)) != 5 || memcmp(buf, "hello", 5) != 0){
+    printf("%s: pipe read returned %d\n", s, n);
+    exit(1);
+  }
+
+  // exit with a read still waiting in the worker.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    r = ioring_setup();
+    iosubmit(r, IORING_OP_READ, fds[0], (uint64)buf, 100, 8);
+    ioring_enter(1, 0);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// readv/writev move several buffers; pread/pwrite
+// leave the file offset alone.
+void
+iovectest(char *s)
+{
+  struct iovec iov[3];
+  char *file = "iovec.tmp";
+  char a[8], b[8];
+  int fd, fds[2], n;
+
+  fd = open(file, O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'z', 3000);
+  iov[0].iov_base = "abc";
+  iov[0].iov_len = 3;
+  iov[1].iov_base = buf;
+  iov[1].iov_len = 3000;
+  iov[2].iov_base = "defgh";
+  iov[2].iov_len = 5;
+  if((n = writev(fd, iov, 3)) != 3008){
+    printf("%s: writev returned %d\n", s, n);
+    exit(1);
+  }
+
+  if(pread(fd, a, 3, 3003) != 3 || memcmp(a, "def", 3) != 0){
+    printf("%s: pread failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fd, "XY", 2, 1) != 2 || write(fd, "!", 1) != 1){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  if(pread(fd, a, 4, 0) != 4){
+    printf("%s: pread failed\n", s);
+    exit(1);
+  }
+  if(memcmp(a, "aXYz", 4) != 0){
+    printf("%s: pwrite wrote the wrong place\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // the pwrite above must not have moved the offset.
+  fd = open(file, O_RDONLY);
+  iov[0].iov_base = a;
+  iov[0].iov_len = 3;
+  iov[1].iov_base = buf;
+  iov[1].iov_len = 3000;
+  iov[2].iov_base = b;
+  iov[2].iov_len = 8;
+  if((n = readv(fd, iov, 3)) != 3009 || memcmp(a, "aXY", 3) != 0 ||
+     memcmp(b, "defgh!", 6) != 0){
+    printf("%s: readv returned %d\n", s, n);
+    exit(1);
+  }
+  if(pread(fd, a, 1, 5000) != 0){
+    printf("%s: pread past the end\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink(file);
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fds[1], "x", 1, 0) != -1 || pread(fds[0], a, 1, 0) != -1){
+    printf("%s: pread/pwrite on a pipe\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = "12";
+  iov[0].iov_len = 2;
+  iov[1].iov_base = "345";
+  iov[1].iov_len = 3;
+  if(writev(fds[1], iov, 2) != 5){
+    printf("%s: writev to pipe\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = a;
+  iov[0].iov_len = 3;
+  iov[1].iov_base = b;
+  iov[1].iov_len = 8;
+  if((n = readv(fds[0], iov, 2)) != 5 || memcmp(a, "123", 3) != 0 ||
+     memcmp(b, "45", 2) != 0){
+    printf("%s: readv from pipe returned %d\n", s, n);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// buffered streams hold output until a flush, and
+// exit() writes out what is left.
+void
+stdiotest(char *s)
+{
+  FILE *fp, *in;
+  char line[32];
+  int fds[2], go[2], ready[2], n, pid, xstatus;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  if((fp = fdopen(fds[1], "w")) == 0 || (in = fdopen(fds[0], "r")) == 0){
+    printf("%s: fdopen failed\n", s);
+    exit(1);
+  }
+  fputs("one\ntwo\n", fp);
+  if((n = read(fds[0], line, sizeof(line))) != -EAGAIN){
+    printf("%s: pipe stream not buffered, read %d\n", s, n);
+    exit(1);
+  }
+  fflush(fp);
+  if(fgets(line, sizeof(line), in) == 0 || strcmp(line, "one\n") != 0 ||
+     fgets(line, sizeof(line), in) == 0 || strcmp(line, "two\n") != 0){
+    printf("%s: fgets got the wrong lines\n", s);
+    exit(1);
+  }
+  if(fgetc(in) != EOF || feof(in)){
+    printf("%s: fgetc of empty pipe\n", s);
+    exit(1);
+  }
+
+  // this process has printed to the console, but once the
+  // child's fd 1 is the pipe, its printf output sits in its
+  // buffer until exit.
+  if(pipe(go) < 0 || pipe(ready) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    dup(fds[1]);
+    for(n = 0; n < 100; n++)
+      printf("%d\n", n % 10);
+    close(go[1]);
+    write(ready[1], "x", 1);
+    read(go[0], line, 1);
+    exit(0);
+  }
+  close(go[0]);
+  close(ready[1]);
+  if(read(ready[0], line, 1) != 1){
+    printf("%s: child did not print\n", s);
+    exit(1);
+  }
+  close(ready[0]);
+  if((n = read(fds[0], line, sizeof(line))) != -EAGAIN){
+    printf("%s: printf to a pipe not buffered, read %d\n", s, n);
+    exit(1);
+  }
+  close(go[1]);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  fclose(fp);
+  for(n = 0; fgetc(in) != EOF; n++)
+    ;
+  if(n != 200 || !feof(in)){
+    printf("%s: read %d bytes of printf output\n", s, n);
+    exit(1);
+  }
+  fclose(in);
+}
+
+// realloc() keeps the contents, and freed blocks
+// coalesce so that growing requests reuse them.
+void
+realloctest(char *s)
+{
+  char *p, *q, *top;
+  int i;
+
+  if(realloc(0, 0) != 0){
+    printf("%s: realloc(0, 0)\n", s);
+    exit(1);
+  }
+  p = 0;
+  for(i = 1; i <= 5000; i += 7){
+    if((p = realloc(p, i)) == 0){
+      printf("%s: realloc failed\n", s);
+      exit(1);
+    }
+    p[i-1] = i;
+    if((q = malloc(24)) == 0){
+      printf("%s: malloc failed\n", s);
+      exit(1);
+    }
+    free(q);
+  }
+  for(i = 1; i <= 5000; i += 7){
+    if(p[i-1] != (char)i){
+      printf("%s: realloc lost byte %d\n", s, i-1);
+      exit(1);
+    }
+  }
+  free(p);
+
+  top = sbrk(0);
+  for(i = 0; i < 20; i++){
+    if((p = malloc(50000 + i*1000)) == 0){
+      printf("%s: malloc failed\n", s);
+      exit(1);
+    }
+    free(p);
+  }
+  if(sbrk(0) - top > 200000){
+    printf("%s: heap grew by %d\n", s, (int)(sbrk(0) - top));
+    exit(1);
+  }
+}
+
+// more open files and pipes at once than the
+// kernel's old fixed-size tables held.
+void
+manyfiles(char *s)
+{
+  enum { NCHILD = 14, NPIPE = 5 };
+  int go[2], ready[2], fds[2], i, j, pid, xstatus;
+  char c;
+
+  if(pipe(go) < 0 || pipe(ready) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(go[1]);
+      close(ready[0]);
+      for(j = 0; j < NPIPE; j++){
+        if(pipe(fds) < 0){
+          printf("%s: pipe %d of child %d failed\n", s, j, i);
+          exit(1);
+        }
+        if(write(fds[1], "x", 1) != 1 || read(fds[0], &c, 1) != 1){
+          printf("%s: pipe i/o failed\n", s);
+          exit(1);
+        }
+      }
+      write(ready[1], "r", 1);
+      // hold everything open until the parent says go.
+      read(go[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(ready[1]);
+  for(i = 0; i < NCHILD; i++){
+    if(read(ready[0], &c, 1) != 1){
+      printf("%s: a child failed\n", s);
+      exit(1);
+    }
+  }
+  close(go[1]);
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+  close(go[0]);
+  close(ready[0]);
+}
+
+// a large aligned sbrk() is backed by megapages; check that
+// they are zeroed, copied by fork(), and can be shrunk
+// into the middle of a megapage, and that growing again
+// where 4096-byte pages used to be works.
+void
+megapagetest(char *s)
+{
+  enum { MEGA=2*1024*1024 };
+  char *a, *p, *top;
+  int pid, xstatus;
+
+  // grow to a megapage boundary, then by two megapages.
+  a = sbrk(0);
+  if(sbrk(MEGA - (uint64)a % MEGA) == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  a = sbrk(2*MEGA);
+  if(a == (char*)-1){
+    printf("%s: sbrk 2 megapages failed\n", s);
+    exit(1);
+  }
+  top = a + 2*MEGA;
+  for(p = a; p < top; p += PGSIZE){
+    if(*p != 0){
+      printf("%s: megapage not zeroed at %p\n", s, p);
+      exit(1);
+    }
+    *p = (uint64)p >> 12;
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(p = a; p < top; p += PGSIZE){
+      if(*p != (char)((uint64)p >> 12)){
+        printf("%s: child sees wrong data at %p\n", s, p);
+        exit(1);
+      }
+      *p = 0;
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+
+  // the child's writes must not show up here; then give back
+  // the second megapage and part of the first.
+  for(p = a; p < top; p += PGSIZE){
+    if(*p != (char)((uint64)p >> 12)){
+      printf("%s: parent sees wrong data at %p\n", s, p);
+      exit(1);
+    }
+  }
+  if(sbrk(-(MEGA + MEGA/2)) == (char*)-1){
+    printf("%s: sbrk shrink failed\n", s);
+    exit(1);
+  }
+  for(p = a; p < a + MEGA/2; p += PGSIZE){
+    if(*p != (char)((uint64)p >> 12)){
+      printf("%s: wrong data at %p after shrink\n", s, p);
+      exit(1);
+    }
+  }
+
+  // one 4096-byte page past the next megapage boundary leaves
+  // a level-0 table there, even once it is given back.
+  if(sbrk(MEGA/2 + PGSIZE) == (char*)-1 || sbrk(-PGSIZE) == (char*)-1){
+    printf("%s: sbrk past boundary failed\n", s);
+    exit(1);
+  }
+  p = sbrk(2*MEGA);
+  if(p != a + MEGA){
+    printf("%s: sbrk regrow failed\n", s);
+    exit(1);
+  }
+  for(top = p + 2*MEGA; p < top; p += PGSIZE){
+    if(*p != 0){
+      printf("%s: not zeroed at %p after regrow\n", s, p);
+      exit(1);
+    }
+    *p = 1;
+  }
+  if(sbrk(-(2*MEGA + MEGA/2)) == (char*)-1){
+    printf("%s: sbrk shrink failed\n", s);
+    exit(1);
+  }
+}
+
+// the directory name cache must follow creates and unlinks,
+// including a directory inode reused for another directory.
+void
+dcachetest(char *s)
+{
+  struct stat st, parent;
+  int fd, i;
+
+  unlink("dcfile");
+  for(i = 0; i < 2; i++){
+    if(open("dcfile", O_RDONLY) >= 0){
+      printf("%s: open of missing file succeeded\n", s);
+      exit(1);
+    }
+    if((fd = open("dcfile", O_CREATE|O_RDWR)) < 0){
+      printf("%s: create dcfile failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if((fd = open("dcfile", O_RDONLY)) < 0){
+      printf("%s: open of new file failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if(unlink("dcfile") < 0){
+      printf("%s: unlink dcfile failed\n", s);
+      exit(1);
+    }
+  }
+
+  if(mkdir("dca") < 0 || mkdir("dcb") < 0 || mkdir("dca/x") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  if(stat("dca/x/..", &st) < 0 || stat("dca/x/.", &st) < 0){
+    printf("%s: stat in dca/x failed\n", s);
+    exit(1);
+  }
+  unlink("dca/x");
+  // likely gets dca/x's inode.
+  if(mkdir("dcb/y") < 0){
+    printf("%s: mkdir dcb/y failed\n", s);
+    exit(1);
+  }
+  if(stat("dcb", &parent) < 0 || stat("dcb/y/..", &st) < 0){
+    printf("%s: stat dcb/y/.. failed\n", s);
+    exit(1);
+  }
+  if(st.ino != parent.ino){
+    printf("%s: dcb/y/.. is inode %d, not %d\n", s, st.ino, parent.ino);
+    exit(1);
+  }
+  unlink("dcb/y");
+  unlink("dcb");
+  unlink("dca");
+}
+
+static void
+hdname(char *name, int i)
+{
+  name[0] = 'h';
+  name[1] = '0' + i / 1000;
+  name[2] = '0' + (i / 100) % 10;
+  name[3] = '0' + (i / 10) % 10;
+  name[4] = '0' + i % 10;
+  name[5] = 0;
+}
+
+// a directory that outgrows a block becomes hashed; it must
+// still read as plain dirents, and be removable once empty.
+// N+2 names don't fit in the two leaf blocks dxconvert()
+// makes, so a leaf must split as well.
+void
+hashdir(char *s)
+{
+  enum { N = 2 * (BSIZE / sizeof(struct dirent)) };
+  struct dirent de;
+  char name[DIRSIZ];
+  int i, fd, n;
+
+  if(mkdir("hd") < 0 || chdir("hd") < 0){
+    printf("%s: mkdir hd failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    hdname(name, i);
+    if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+  }
+
+  fd = open(".", O_RDONLY);
+  n = 0;
+  while(read(fd, &de, sizeof(de)) == sizeof(de))
+    if(de.inum != 0)
+      n++;
+  close(fd);
+  if(n != N + 2){
+    printf("%s: read %d names from hd, not %d\n", s, n, N + 2);
+    exit(1);
+  }
+
+  for(i = N - 1; i >= 0; i--){
+    hdname(name, i);
+    if((fd = open(name, O_RDONLY)) < 0){
+      printf("%s: open %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+    if(unlink(name) < 0){
+      printf("%s: unlink %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  if(chdir("..") < 0 || unlink("hd") < 0){
+    printf("%s: unlink hd failed\n", s);
+    exit(1);
+  }
+}
+
+// several processes each write() a file many blocks long
+// in one call, so the writes need big log reservations at
+// the same time.
+void
+bigtxn(char *s)
+{
+  enum { NCHILD = 4, SZ = 64*1024 };
+  char name[] = "bigtxn0";
+  char *p;
+  int i, j, fd, pid, xstatus;
+
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      name[6] = '0' + i;
+      if((p = malloc(SZ)) == 0){
+        printf("%s: malloc failed\n", s);
+        exit(1);
+      }
+      for(j = 0; j < SZ; j++)
+        p[j] = i + j / BSIZE;
+      if((fd = open(name, O_CREATE|O_RDWR)) < 0 || write(fd, p, SZ) != SZ){
+        printf("%s: write %s failed\n", s, name);
+        exit(1);
+      }
+      close(fd);
+      memset(p, 0, SZ);
+      if((fd = open(name, O_RDONLY)) < 0 || read(fd, p, SZ) != SZ){
+        printf("%s: read %s failed\n", s, name);
+        exit(1);
+      }
+      close(fd);
+      for(j = 0; j < SZ; j++){
+        if(p[j] != (char)(i + j / BSIZE)){
+          printf("%s: %s has wrong content\n", s, name);
+          exit(1);
+        }
+      }
+      unlink(name);
+      exit(0);
+    }
+  }
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+}
+
 // test if child is killed (status = -1)
 void
 killstatus(char *s)
@@ -2609,6 +3728,20 @@ struct test {
   {dirtest, "dirtest"},
   {exectest, "exectest"},
   {pipe1, "pipe1"},
+  {pipebig, "pipebig"},
+  {splicetest, "splice"},
+  {sendfiletest, "sendfile"},
+  {polltest, "poll"},
+  {nonblocktest, "nonblock"},
+  {ioringtest, "ioring"},
+  {iovectest, "iovec"},
+  {stdiotest, "stdio"},
+  {realloctest, "realloc"},
+  {manyfiles, "manyfiles"},
+  {megapagetest, "megapage"},
+  {dcachetest, "dcache"},
+  {hashdir, "hashdir"},
+  {bigtxn, "bigtxn"},
   {killstatus, "killstatus"},
   {preempt, "preempt"},
   {exitwait, "exitwait"},
@@ -2852,7 +3985,6 @@ diskfull(char *s)
       break;
     }
     for(int i = 0; i < MAXFILE; i++){
-      char buf[BSIZE];
       if(write(fd, buf, BSIZE) != BSIZE){
         done = 1;
         close(fd);
@@ -6,24 +6,27 @@ print "# generated by usys.pl - do not edit\n";
 
 print "#include \"kernel/syscall.h\"\n";
 
+# entry("name", "sym") names the stub sym instead, for
+# calls that ulib.c wraps.
 sub entry {
     my $name = shift;
-    print ".global $name\n";
-    print "${name}:\n";
+    my $sym = shift || $name;
+    print ".global $sym\n";
+    print "${sym}:\n";
     print " li a7, SYS_${name}\n";
     print " ecall\n";
     print " ret\n";
 }
 	
-entry("fork");
-entry("exit");
+entry("fork", "_fork");
+entry("exit", "_exit");
 entry("wait");
 entry("pipe");
 entry("read");
 entry("write");
 entry("close");
 entry("kill");
-entry("exec");
+entry("exec", "_exec");
 entry("open");
 entry("mknod");
 entry("unlink");
@@ -31,8 +34,18 @@ entry("fstat");
 entry("link");
 entry("mkdir");
 entry("chdir");
-entry("dup");
+entry("dup", "_dup");
 entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("splice");
+entry("sendfile");
+entry("poll");
+entry("fcntl");
+entry("ioring_setup");
+entry("ioring_enter");
+entry("readv");
+entry("writev");
+entry("pread");
+entry("pwrite");